@@ -0,0 +1,462 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "batchload.hh"
+#include "file.hh"
+#include "iscparser.hh"
+#include "parallel.hh"
+#include "stats.hh"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(STATX_SIZE)
+# define HAVE_URING 1
+# include <linux/io_uring.h>
+#endif
+
+
+BatchLoader::~BatchLoader() {
+	for (std::vector<Entry>::iterator i=entries.begin(); i!=entries.end(); i++)
+		if (i->data)
+			BufferPool::instance().release(i->data, i->capacity);
+}
+
+
+void BatchLoader::Add(const std::string &name) {
+	Entry entry;
+
+	entry.name=name;
+	entry.data=0;
+	entry.size=0;
+	entry.capacity=0;
+	entry.error=0;
+	entries.push_back(entry);
+}
+
+
+BatchLoader::method_type BatchLoader::Load(method_type how) {
+	STATS_TIMER(Load);
+	const size_t first = loaded;
+
+	if (first==entries.size())
+		return how==Auto ? Threads : how;
+
+	if (how!=Threads && LoadUring(first))
+		how=Uring;
+	else if (how==Uring)
+		throw std::runtime_error("io_uring is not available");
+	else {
+		LoadThreads(first);
+		how=Threads;
+	}
+
+	loaded=entries.size();
+	for (size_t i=first; i<loaded; i++)
+		STATS_ADD(bytesLoaded, entries[i].size);
+	return how;
+}
+
+
+void BatchLoader::LoadEntry(Entry &entry) {
+	int fd = ::open(entry.name.c_str(), O_RDONLY|O_CLOEXEC);
+	struct stat st;
+
+	if (fd==-1) {
+		entry.error=errno;
+		return;
+	}
+
+	if (fstat(fd, &st)==-1) {
+		entry.error=errno;
+		::close(fd);
+		return;
+	}
+
+	entry.data=BufferPool::instance().acquire(st.st_size, entry.capacity);
+	while (entry.size<static_cast<size_t>(st.st_size)) {
+		ssize_t len = ::read(fd, entry.data+entry.size, st.st_size-entry.size);
+
+		if (len==-1 && errno==EINTR)
+			continue;
+		if (len==-1) {
+			entry.error=errno;
+			break;
+		}
+		if (len==0)
+			break;	// file shrunk
+		entry.size+=len;
+	}
+
+	::close(fd);
+}
+
+
+void BatchLoader::LoadJob(void *context, size_t index) {
+	LoadEntry(static_cast<Entry*>(context)[index]);
+}
+
+
+void BatchLoader::LoadThreads(size_t first) {
+	if (entries.size()-first==1) {
+		LoadEntry(entries[first]);
+		return;
+	}
+
+	// Each file is blocking I/O, so use more threads than processors.
+	unsigned int threads = ProcessorCount()*2;
+	if (threads>depth)
+		threads=depth;
+
+	ParallelFor(entries.size()-first, LoadJob, &entries[first], threads);
+}
+
+
+#ifdef HAVE_URING
+
+static int uring_setup(unsigned int entries, struct io_uring_params *params) {
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static int uring_enter(int fd, unsigned int submit, unsigned int wait, unsigned int flags) {
+	return syscall(__NR_io_uring_enter, fd, submit, wait, flags, 0, 0);
+}
+
+
+/* A minimal io_uring: just enough to submit requests and reap
+ * completions. */
+class UringLoad : public boost::noncopyable {
+public:
+	UringLoad(BatchLoader &loader, size_t first);
+	~UringLoad();
+
+	/** Check if the ring was set up. */
+	bool ok() const { return fd!=-1; }
+
+	/** Load all files. */
+	void Run();
+
+protected:
+	/** Operations, stored in the low bits of the request user data. */
+	enum op_type { OpOpen, OpStat, OpRead, OpClose };
+
+	/** State of a file being loaded. */
+	struct FileState {
+		int		fd;		/*!< file descriptor once opened */
+		unsigned int	pending;	/*!< requests in flight */
+		struct statx	stx;		/*!< statx result */
+	};
+
+	struct io_uring_sqe *GetSqe(size_t index, op_type op);
+	void Submit(unsigned int wait);
+	void Complete(size_t index, op_type op, int res);
+	void Start(size_t index);
+	void Read(size_t index);
+	void Close(size_t index);
+
+	BatchLoader::Entry &entry(size_t index) { return loader.entries[first+index]; }
+
+	BatchLoader			&loader;
+	size_t				first;
+	size_t				count;
+	std::vector<FileState>		files;
+	size_t				active;		/*!< files in flight */
+
+	int				fd;
+	unsigned int			tail;		/*!< our submission queue tail */
+	void				*sqring, *cqring;
+	size_t				sqringsize, cqringsize;
+	struct io_uring_sqe		*sqes;
+	size_t				sqessize;
+	unsigned int			*sqhead, *sqtail, *sqmask, *sqarray;
+	unsigned int			*cqhead, *cqtail, *cqmask;
+	struct io_uring_cqe		*cqes;
+};
+
+
+UringLoad::UringLoad(BatchLoader &loader, size_t first) :
+		loader(loader), first(first), count(loader.entries.size()-first), active(0),
+		fd(-1), tail(0), sqring(MAP_FAILED), cqring(MAP_FAILED), sqes(0) {
+	struct io_uring_params params;
+
+	memset(&params, 0, sizeof(params));
+	// two requests per file can be in flight
+	if ((fd=uring_setup(2*loader.depth, &params))==-1)
+		return;
+
+	// openat, statx, read and close all arrived in Linux 5.6, as did
+	// IORING_FEAT_RW_CUR_POS
+	if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+		::close(fd);
+		fd=-1;
+		return;
+	}
+
+	sqringsize=params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+	cqringsize=params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		sqringsize=cqringsize=std::max(sqringsize, cqringsize);
+	sqessize=params.sq_entries*sizeof(struct io_uring_sqe);
+
+	sqring=mmap(0, sqringsize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		cqring=sqring;
+	else
+		cqring=mmap(0, cqringsize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	void *map = mmap(0, sqessize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+
+	if (sqring==MAP_FAILED || cqring==MAP_FAILED || map==MAP_FAILED) {
+		if (map!=MAP_FAILED)
+			munmap(map, sqessize);
+		::close(fd);	// the destructor unmaps the rings
+		fd=-1;
+		return;
+	}
+	sqes=static_cast<struct io_uring_sqe*>(map);
+
+	char *sq = static_cast<char*>(sqring);
+	sqhead=reinterpret_cast<unsigned int*>(sq+params.sq_off.head);
+	sqtail=reinterpret_cast<unsigned int*>(sq+params.sq_off.tail);
+	sqmask=reinterpret_cast<unsigned int*>(sq+params.sq_off.ring_mask);
+	sqarray=reinterpret_cast<unsigned int*>(sq+params.sq_off.array);
+
+	char *cq = static_cast<char*>(cqring);
+	cqhead=reinterpret_cast<unsigned int*>(cq+params.cq_off.head);
+	cqtail=reinterpret_cast<unsigned int*>(cq+params.cq_off.tail);
+	cqmask=reinterpret_cast<unsigned int*>(cq+params.cq_off.ring_mask);
+	cqes=reinterpret_cast<struct io_uring_cqe*>(cq+params.cq_off.cqes);
+
+	tail=*sqtail;
+}
+
+
+UringLoad::~UringLoad() {
+	if (sqes)
+		munmap(sqes, sqessize);
+	if (cqring!=MAP_FAILED && cqring!=sqring)
+		munmap(cqring, cqringsize);
+	if (sqring!=MAP_FAILED)
+		munmap(sqring, sqringsize);
+	if (fd!=-1)
+		::close(fd);
+}
+
+
+struct io_uring_sqe *UringLoad::GetSqe(size_t index, op_type op) {
+	unsigned int slot = tail++ & *sqmask;
+	struct io_uring_sqe *sqe = &sqes[slot];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data=(static_cast<uint64_t>(index)<<2) | op;
+	sqarray[slot]=slot;
+	files[index].pending++;
+	return sqe;
+}
+
+
+void UringLoad::Submit(unsigned int wait) {
+	__atomic_store_n(sqtail, tail, __ATOMIC_RELEASE);
+
+	for (;;) {
+		unsigned int submit = tail - __atomic_load_n(sqhead, __ATOMIC_ACQUIRE);
+
+		if (uring_enter(fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0)!=-1)
+			break;
+		if (errno!=EINTR)
+			throw system_exception("io_uring_enter");
+	}
+}
+
+
+void UringLoad::Start(size_t index) {
+	const char *name = entry(index).name.c_str();
+	struct io_uring_sqe *sqe;
+
+	files[index].fd=-1;
+	files[index].pending=0;
+
+	sqe=GetSqe(index, OpOpen);
+	sqe->opcode=IORING_OP_OPENAT;
+	sqe->fd=AT_FDCWD;
+	sqe->addr=reinterpret_cast<uintptr_t>(name);
+	sqe->open_flags=O_RDONLY|O_CLOEXEC;
+
+	sqe=GetSqe(index, OpStat);
+	sqe->opcode=IORING_OP_STATX;
+	sqe->fd=AT_FDCWD;
+	sqe->addr=reinterpret_cast<uintptr_t>(name);
+	sqe->len=STATX_SIZE;
+	sqe->off=reinterpret_cast<uintptr_t>(&files[index].stx);
+
+	active++;
+}
+
+
+void UringLoad::Read(size_t index) {
+	BatchLoader::Entry &e = entry(index);
+	struct io_uring_sqe *sqe = GetSqe(index, OpRead);
+
+	sqe->opcode=IORING_OP_READ;
+	sqe->fd=files[index].fd;
+	sqe->addr=reinterpret_cast<uintptr_t>(e.data+e.size);
+	sqe->len=files[index].stx.stx_size-e.size;
+	sqe->off=e.size;
+}
+
+
+void UringLoad::Close(size_t index) {
+	struct io_uring_sqe *sqe = GetSqe(index, OpClose);
+
+	sqe->opcode=IORING_OP_CLOSE;
+	sqe->fd=files[index].fd;
+}
+
+
+void UringLoad::Complete(size_t index, op_type op, int res) {
+	BatchLoader::Entry &e = entry(index);
+	FileState &file = files[index];
+
+	file.pending--;
+
+	switch (op) {
+		case OpOpen:
+		case OpStat:
+			if (res<0 && !e.error)
+				e.error=-res;
+			else if (op==OpOpen && res>=0)
+				file.fd=res;
+
+			if (file.pending)
+				return;	// wait for the other one
+			if (e.error) {
+				if (file.fd!=-1)
+					Close(index);
+				else
+					active--;
+				return;
+			}
+			if (file.stx.stx_size>static_cast<size_t>(-1)/2) {
+				e.error=EFBIG;
+				Close(index);
+				return;
+			}
+			e.data=BufferPool::instance().acquire(file.stx.stx_size, e.capacity);
+			if (file.stx.stx_size)
+				Read(index);
+			else
+				Close(index);
+			return;
+
+		case OpRead:
+			if (res==-EINTR || res==-EAGAIN)
+				Read(index);
+			else if (res<0) {
+				e.error=-res;
+				Close(index);
+			} else if (res==0) {
+				// file shrunk
+				Close(index);
+			} else {
+				e.size+=res;
+				if (e.size<file.stx.stx_size)
+					Read(index);
+				else
+					Close(index);
+			}
+			return;
+
+		case OpClose:
+			file.fd=-1;
+			active--;
+			return;
+	}
+}
+
+
+void UringLoad::Run() {
+	size_t next = 0;
+
+	files.resize(count);
+	while (next<count || active) {
+		while (next<count && active<loader.depth)
+			Start(next++);
+
+		Submit(1);
+
+		unsigned int head = *cqhead;
+		unsigned int tail = __atomic_load_n(cqtail, __ATOMIC_ACQUIRE);
+		for (; head!=tail; head++) {
+			const struct io_uring_cqe &cqe = cqes[head & *cqmask];
+			Complete(cqe.user_data>>2, static_cast<op_type>(cqe.user_data & 3), cqe.res);
+		}
+		__atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+	}
+}
+
+
+bool BatchLoader::LoadUring(size_t first) {
+	UringLoad load(*this, first);
+
+	if (!load.ok())
+		return false;
+	load.Run();
+	return true;
+}
+
+
+bool BatchLoader::UringAvailable() {
+	BatchLoader loader(1);
+	UringLoad load(loader, 0);
+
+	return load.ok();
+}
+
+#else
+
+bool BatchLoader::LoadUring(size_t) {
+	return false;
+}
+
+
+bool BatchLoader::UringAvailable() {
+	return false;
+}
+
+#endif
+
+
+std::vector<boost::shared_ptr<ConfigData> > ReadConfigs(const std::vector<std::string> &names,
+		config_format format) {
+	std::vector<boost::shared_ptr<ConfigData> > result;
+	BatchLoader loader;
+
+	for (std::vector<std::string>::const_iterator i=names.begin(); i!=names.end(); i++)
+		loader.Add(*i);
+	loader.Load();
+
+	for (size_t i=0; i<loader.size(); i++)
+		if (loader[i].error)
+			throw system_exception(loader[i].name, loader[i].error);
+
+	result.reserve(loader.size());
+	for (size_t i=0; i<loader.size(); i++) {
+		try {
+			result.push_back(ParseConfig(loader[i].data, loader[i].size, format));
+		} catch (parse_error &e) {
+			e.SetFile(loader[i].name);
+			throw;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_batchload_included__
+#define __wta_batchload_included__
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "configdata.hh"
+#include "readconfig.hh"
+
+
+/** Loader for many files at once.
+ *
+ * Reading a file through MemoryFile costs a sequence of system calls per
+ * file, which adds up when loading thousands of small files. BatchLoader
+ * reads a whole set of files into pooled buffers (see BufferPool) and
+ * overlaps the work for different files.
+ *
+ * On Linux io_uring is used: the open and stat requests for a file are
+ * submitted together, followed by the reads and closes, with many files in
+ * flight and a single system call per round of requests. If io_uring is
+ * not available the files are read with plain system calls on a number
+ * of threads instead.
+ *
+ * A file which can not be read does not stop the others from loading; its
+ * error is recorded in its entry.
+ *
+ * \code
+ * BatchLoader loader;
+ * for (...)
+ *     loader.Add(name);
+ * loader.Load();
+ * for (size_t i=0; i<loader.size(); i++)
+ *     Tokenizer(loader[i].data, loader[i].size).Tokenize(parser);
+ * \endcode
+ */
+class BatchLoader : public boost::noncopyable {
+public:
+	/** A file to load. */
+	struct Entry {
+		std::string	name;		/*!< path of the file */
+		char		*data;		/*!< file contents once loaded */
+		size_t		size;		/*!< size of the file contents */
+		size_t		capacity;	/*!< capacity of the buffer */
+		int		error;		/*!< errno value if loading failed, 0 otherwise */
+	};
+
+	/** Ways to load the files. */
+	enum method_type {
+		Auto,		/*!< use io_uring if the kernel supports it */
+		Uring,		/*!< use io_uring */
+		Threads		/*!< use blocking system calls on several threads */
+	};
+
+	/** Standard constructor.
+	 * \param depth maximum number of files in flight at a time
+	 */
+	explicit BatchLoader(unsigned int depth=64) : depth(depth ? depth : 1), loaded(0) { }
+
+	~BatchLoader();
+
+	/** Add a file to the set. */
+	void Add(const std::string &name);
+
+	/** Load all files which have not been loaded yet.
+	 * \param how method used to read the files
+	 * \return method that was used
+	 */
+	method_type Load(method_type how=Auto);
+
+	/** Return the number of files. */
+	size_t size() const { return entries.size(); }
+
+	/** Return a file. */
+	const Entry &operator[](size_t index) const { return entries[index]; }
+
+	/** Check if io_uring can be used on this system. */
+	static bool UringAvailable();
+
+protected:
+	/** Load entries [first, entries.size()) with io_uring.
+	 * \return false if io_uring could not be set up
+	 */
+	bool LoadUring(size_t first);
+
+	/** Load entries [first, entries.size()) with a thread pool. */
+	void LoadThreads(size_t first);
+
+	/** Load an entry with blocking system calls. */
+	static void LoadEntry(Entry &entry);
+
+	static void LoadJob(void *context, size_t index);
+
+	unsigned int		depth;		/*!< maximum number of files in flight */
+	std::vector<Entry>	entries;	/*!< files */
+	size_t			loaded;		/*!< number of entries already loaded */
+
+	friend class UringLoad;
+};
+
+
+/** Read many configuration files.
+ * Loads the files with a BatchLoader and parses them in order. If a file
+ * can not be read a system_exception for the first such file is thrown.
+ *
+ * \param names paths of the files to read
+ * \param format format of the files
+ * \return the parsed configurations, in the same order as \a names
+ */
+std::vector<boost::shared_ptr<ConfigData> > ReadConfigs(const std::vector<std::string> &names,
+		config_format format=AutoFormat);
+
+#endif
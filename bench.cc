@@ -0,0 +1,750 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "corpus.hh"
+#include "file.hh"
+#include "tokenize.hh"
+#include "tokentee.hh"
+#include "iscparser.hh"
+#include "configdata.hh"
+#include "iscwriter.hh"
+#include "batchload.hh"
+#include "frozen.hh"
+#include "frozenparser.hh"
+#include "listindex.hh"
+
+/*
+ * Benchmark driver.
+ *
+ * Every benchmark prints a single JSON object per line on standard output
+ * so results can be collected and compared by scripts. Timings are the
+ * median of a number of repetitions after a warm-up run.
+ */
+
+static unsigned long allocations = 0;
+static volatile unsigned long sink = 0;
+
+// Every allocation and release goes straight to malloc and free, and the
+// count is updated atomically since BatchLoader and ParallelMerge allocate
+// from several threads.
+static void *countedalloc(size_t size) {
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	__sync_fetch_and_add(&allocations, 1);
+	return p;
+}
+
+void *operator new(size_t size) {
+	return countedalloc(size);
+}
+
+void *operator new[](size_t size) {
+	return countedalloc(size);
+}
+
+void operator delete(void *p) throw() {
+	free(p);
+}
+
+void operator delete[](void *p) throw() {
+	free(p);
+}
+
+void operator delete(void *p, size_t) throw() {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) throw() {
+	free(p);
+}
+
+
+/** Token handler which only counts tokens. */
+class CountingHandler : public TokenHandler {
+public:
+	CountingHandler() : tokens(0) { }
+
+	virtual void HandleString(const char*, size_t) { tokens++; }
+	virtual void HandleInteger(const char*, size_t) { tokens++; }
+	virtual void HandleKeyword(const char*, size_t) { tokens++; }
+	virtual void HandleCharacter(const char*, size_t) { tokens++; }
+	virtual void HandleWhitespace(const char*, size_t) { tokens++; }
+	virtual void HandleEndOfInput() { }
+
+	unsigned long tokens;
+};
+
+
+/** Result of a single benchmark. */
+struct Result {
+	Result() : size(0), reps(0), median(0), min(0), bytes(0), tokens(0), ops(0), allocs(0) { }
+
+	std::string	name;	/*!< benchmark name */
+	std::string	shape;	/*!< corpus shape */
+	off_t		size;	/*!< corpus size in bytes */
+	unsigned int	reps;	/*!< number of timed repetitions */
+	double		median;	/*!< median time per repetition in ns */
+	double		min;	/*!< fastest repetition in ns */
+	double		bytes;	/*!< bytes processed per repetition */
+	double		tokens;	/*!< tokens processed per repetition */
+	double		ops;	/*!< operations (nodes, lookups) per repetition */
+	double		allocs;	/*!< allocations per repetition */
+};
+
+
+static double now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+
+static long peakrss() {
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+
+static void report(const Result &r) {
+	double secs = r.median/1e9;
+
+	printf("{\"bench\":\"%s\",\"shape\":\"%s\",\"size\":%lld,\"reps\":%u,"
+		"\"median_ns\":%.0f,\"min_ns\":%.0f",
+		r.name.c_str(), r.shape.c_str(), (long long)r.size, r.reps,
+		r.median, r.min);
+	if (r.bytes)
+		printf(",\"bytes_per_s\":%.0f", r.bytes/secs);
+	if (r.tokens)
+		printf(",\"tokens_per_s\":%.0f", r.tokens/secs);
+	if (r.ops)
+		printf(",\"ops\":%.0f,\"ns_per_op\":%.2f", r.ops, r.median/r.ops);
+	printf(",\"allocs\":%.0f,\"peak_rss_kb\":%ld}\n", r.allocs, peakrss());
+	fflush(stdout);
+}
+
+
+static void summarize(Result &r, std::vector<double> &times, unsigned long allocs) {
+	std::sort(times.begin(), times.end());
+	r.reps=times.size();
+	r.median=times[times.size()/2];
+	r.min=times[0];
+	r.allocs=static_cast<double>(allocs)/times.size();
+}
+
+
+static boost::shared_ptr<ConfigData> parse(const char *data, size_t size) {
+	Tokenizer toker(data, size);
+	ISCParser parser;
+
+	toker(parser);
+	return parser.cfg;
+}
+
+
+static unsigned long countnodes(const ConfigData &cfg) {
+	unsigned long count = 1;
+
+	for (ConfigData::map_type::const_iterator i=cfg.mapValue.begin(); i!=cfg.mapValue.end(); i++)
+		count+=countnodes(*i->second);
+	for (ConfigData::list_type::const_iterator i=cfg.listValue.begin(); i!=cfg.listValue.end(); i++)
+		count+=countnodes(**i);
+	if (cfg.packed)
+		count+=cfg.packed->size();
+	return count;
+}
+
+
+static void collectpaths(const ConfigData &cfg, std::vector<std::string> &path,
+		std::vector<std::vector<std::string> > &paths) {
+	for (ConfigData::map_type::const_iterator i=cfg.mapValue.begin(); i!=cfg.mapValue.end(); i++) {
+		path.push_back(i->first);
+		if (i->second->type==ConfigData::Map)
+			collectpaths(*i->second, path, paths);
+		else
+			paths.push_back(path);
+		path.pop_back();
+	}
+}
+
+
+static const ConfigData *largestlist(const ConfigData &cfg) {
+	const ConfigData *best = cfg.type==ConfigData::List ? &cfg : 0;
+
+	for (ConfigData::map_type::const_iterator i=cfg.mapValue.begin(); i!=cfg.mapValue.end(); i++) {
+		const ConfigData *list = largestlist(*i->second);
+		if (list && (!best || list->ListSize()>best->ListSize()))
+			best=list;
+	}
+	return best;
+}
+
+
+static bool listcontains(const ConfigData &list, const ConfigData &value) {
+	const ConfigData::list_type &entries = list.Entries();
+
+	for (ConfigData::list_type::const_iterator i=entries.begin(); i!=entries.end(); i++)
+		if ((*i)->type==value.type && (value.type==ConfigData::Integer ?
+				(*i)->intValue==value.intValue : (*i)->strValue==value.strValue))
+			return true;
+	return false;
+}
+
+
+static void runbenchmarks(CorpusGenerator::shape_type shape, off_t size, unsigned int reps) {
+	const char *tmpdir = getenv("TMPDIR");
+	std::string tmpl = std::string(tmpdir ? tmpdir : "/tmp") + "/sict-bench-XXXXXX";
+	std::vector<char> name(tmpl.begin(), tmpl.end());
+	name.push_back(0);
+
+	int fd = mkstemp(&name[0]);
+	if (fd==-1)
+		throw system_exception(tmpl);
+	::close(fd);
+
+	{
+		std::ofstream out(&name[0], std::ios::binary);
+		CorpusGenerator gen(shape);
+		gen(out, size);
+		if (!out)
+			throw system_exception(&name[0]);
+	}
+
+	MemoryFile input(&name[0]);
+	const size_t len = input.size;
+	std::vector<double> times;
+	unsigned long allocs;
+	Result base;
+
+	base.shape=CorpusGenerator::ShapeName(shape);
+	base.size=input.size;
+
+	// Tokenizer throughput
+	{
+		Result r = base;
+		CountingHandler warm;
+		Tokenizer(input.data, len)(warm);
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			CountingHandler counter;
+			double start = now();
+			Tokenizer(input.data, len)(counter);
+			times.push_back(now()-start);
+		}
+		r.name="tokenize";
+		r.bytes=len;
+		r.tokens=warm.tokens;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// ISCParser tree build
+	boost::shared_ptr<ConfigData> tree = parse(input.data, len);
+	const unsigned long nodes = countnodes(*tree);
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			double start = now();
+			boost::shared_ptr<ConfigData> cfg = parse(input.data, len);
+			times.push_back(now()-start);
+		}
+		r.name="parse";
+		r.bytes=len;
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// ISCParser plus a second consumer from a single scan
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			ISCParser parser;
+			CountingHandler counter;
+			TokenPair<ISCParser, CountingHandler> pair(parser, counter);
+			double start = now();
+			Tokenizer(input.data, len).Tokenize(pair);
+			times.push_back(now()-start);
+		}
+		r.name="parse-tee";
+		r.bytes=len;
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// ConfigData::Merge into an empty map
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			ConfigData copy(ConfigData::Map);
+			double start = now();
+			copy.Merge(*tree, true, true);
+			times.push_back(now()-start);
+		}
+		r.name="merge";
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// the same merge using all processors
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			ConfigData copy(ConfigData::Map);
+			double start = now();
+			copy.ParallelMerge(*tree, true, true);
+			times.push_back(now()-start);
+		}
+		r.name="merge-parallel";
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// operator[] lookups of scalar values
+	{
+		Result r = base;
+		std::vector<std::string> path;
+		std::vector<std::vector<std::string> > paths;
+		std::vector<std::vector<std::string> > sample;
+
+		collectpaths(*tree, path, paths);
+		for (unsigned int i=0; i<4096 && !paths.empty(); i++)
+			sample.push_back(paths[(i*2654435761u)%paths.size()]);
+
+		if (!sample.empty()) {
+			unsigned long lookups = 0;
+
+			times.clear();
+			allocs=allocations;
+			for (unsigned int i=0; i<reps; i++) {
+				lookups=0;
+				double start = now();
+				for (std::vector<std::vector<std::string> >::const_iterator p=sample.begin(); p!=sample.end(); p++) {
+					const ConfigData *node = tree.get();
+					for (std::vector<std::string>::const_iterator k=p->begin(); k!=p->end(); k++) {
+						node=&(*node)[*k];
+						lookups++;
+					}
+					sink+=node->type;
+				}
+				times.push_back(now()-start);
+			}
+			r.name="lookup";
+			r.ops=lookups;
+			summarize(r, times, allocations-allocs);
+			report(r);
+
+			// the same lookups on a frozen copy
+			FrozenConfig frozen(*tree);
+
+			r=base;
+			times.clear();
+			allocs=allocations;
+			for (unsigned int i=0; i<reps; i++) {
+				lookups=0;
+				double start = now();
+				for (std::vector<std::vector<std::string> >::const_iterator p=sample.begin(); p!=sample.end(); p++) {
+					FrozenData node = frozen.root();
+					for (std::vector<std::string>::const_iterator k=p->begin(); k!=p->end(); k++) {
+						node=node[*k];
+						lookups++;
+					}
+					sink+=node.type();
+				}
+				times.push_back(now()-start);
+			}
+			r.name="frozen-lookup";
+			r.ops=lookups;
+			summarize(r, times, allocations-allocs);
+			report(r);
+		}
+	}
+
+	// membership tests on the largest list: linear scan versus ListIndex
+	if (const ConfigData *list = largestlist(*tree)) {
+		const ConfigData::list_type &entries = list->Entries();
+		std::vector<const ConfigData*> sample;
+
+		for (unsigned int i=0; i<4096 && !entries.empty(); i++) {
+			const ConfigData *value = entries[(i*2654435761u)%entries.size()].get();
+			if (value->type==ConfigData::Integer || value->type==ConfigData::String)
+				sample.push_back(value);
+		}
+
+		if (!sample.empty()) {
+			Result r = base;
+
+			times.clear();
+			allocs=allocations;
+			for (unsigned int i=0; i<reps; i++) {
+				double start = now();
+				for (std::vector<const ConfigData*>::const_iterator v=sample.begin(); v!=sample.end(); v++)
+					sink+=listcontains(*list, **v);
+				times.push_back(now()-start);
+			}
+			r.name="list-scan";
+			r.ops=sample.size();
+			summarize(r, times, allocations-allocs);
+			report(r);
+
+			ListIndex index(*list);
+
+			r=base;
+			times.clear();
+			allocs=allocations;
+			for (unsigned int i=0; i<reps; i++) {
+				double start = now();
+				for (std::vector<const ConfigData*>::const_iterator v=sample.begin(); v!=sample.end(); v++)
+					sink+=(*v)->type==ConfigData::Integer ? index.Contains((*v)->intValue) : index.Contains((*v)->strValue);
+				times.push_back(now()-start);
+			}
+			r.name="list-index";
+			r.ops=sample.size();
+			summarize(r, times, allocations-allocs);
+			report(r);
+		}
+	}
+
+	// FrozenConfig construction
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			double start = now();
+			FrozenConfig frozen(*tree);
+			times.push_back(now()-start);
+		}
+		r.name="freeze";
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// FrozenConfig straight from the input
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			double start = now();
+			boost::shared_ptr<FrozenConfig> frozen = ParseFrozen(input.data, len);
+			times.push_back(now()-start);
+		}
+		r.name="parse-frozen";
+		r.bytes=len;
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// ISCWriter output, discarding the result
+	{
+		Result r = base;
+		File devnull("/dev/null", File::WriteOnly);
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			double start = now();
+			ISCWriter writer(devnull.fileno);
+			writer.Write(*tree);
+			writer.Flush();
+			times.push_back(now()-start);
+		}
+		r.name="write";
+		r.bytes=len;
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// tree teardown
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			boost::shared_ptr<ConfigData> cfg = parse(input.data, len);
+			double start = now();
+			cfg.reset();
+			times.push_back(now()-start);
+		}
+		r.name="teardown";
+		r.ops=nodes;
+		summarize(r, times, 0);
+		report(r);
+	}
+
+	// complete load from disk (page cache warm)
+	{
+		Result r = base;
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			double start = now();
+			{
+				MemoryFile file(&name[0]);
+				boost::shared_ptr<ConfigData> cfg = parse(file.data, file.size);
+			}
+			times.push_back(now()-start);
+		}
+		r.name="load";
+		r.bytes=len;
+		r.ops=nodes;
+		summarize(r, times, allocations-allocs);
+		report(r);
+	}
+
+	// many small files: one MemoryFile per file versus BatchLoader
+	{
+		const unsigned int count = 256;
+		std::string dir = std::string(&name[0]) + ".d";
+		std::vector<std::string> files;
+
+		if (mkdir(dir.c_str(), 0700)==-1)
+			throw system_exception(dir);
+		for (unsigned int i=0; i<count; i++) {
+			char buf[32];
+			snprintf(buf, sizeof(buf), "/%u.conf", i);
+			files.push_back(dir+buf);
+
+			std::ofstream out(files.back().c_str(), std::ios::binary);
+			CorpusGenerator gen(shape, i+1);
+			gen(out, std::max(size/count, static_cast<off_t>(512)));
+		}
+
+		Result r = base;
+		off_t total = 0;
+
+		for (std::vector<std::string>::const_iterator f=files.begin(); f!=files.end(); f++) {
+			struct stat st;
+			if (stat(f->c_str(), &st)==0)
+				total+=st.st_size;
+		}
+
+		times.clear();
+		allocs=allocations;
+		for (unsigned int i=0; i<reps; i++) {
+			double start = now();
+			for (std::vector<std::string>::const_iterator f=files.begin(); f!=files.end(); f++) {
+				MemoryFile file(f->c_str());
+				sink+=file.size;
+			}
+			times.push_back(now()-start);
+		}
+		r.name="load-files";
+		r.bytes=total;
+		r.ops=count;
+		summarize(r, times, allocations-allocs);
+		report(r);
+
+		BatchLoader::method_type methods[] = { BatchLoader::Uring, BatchLoader::Threads };
+		for (unsigned int m=0; m<2; m++) {
+			if (methods[m]==BatchLoader::Uring && !BatchLoader::UringAvailable())
+				continue;
+
+			r=base;
+			times.clear();
+			allocs=allocations;
+			for (unsigned int i=0; i<reps; i++) {
+				double start = now();
+				BatchLoader loader;
+				for (std::vector<std::string>::const_iterator f=files.begin(); f!=files.end(); f++)
+					loader.Add(*f);
+				loader.Load(methods[m]);
+				times.push_back(now()-start);
+			}
+			r.name=methods[m]==BatchLoader::Uring ? "load-batch-uring" : "load-batch-threads";
+			r.bytes=total;
+			r.ops=count;
+			summarize(r, times, allocations-allocs);
+			report(r);
+		}
+
+		for (std::vector<std::string>::const_iterator f=files.begin(); f!=files.end(); f++)
+			unlink(f->c_str());
+		rmdir(dir.c_str());
+	}
+
+	input.close();
+	unlink(&name[0]);
+}
+
+
+static bool parsesize(const char *arg, off_t &size) {
+	char *end;
+	double value = strtod(arg, &end);
+
+	switch (*end) {
+		case 'k': case 'K': value*=1024; end++; break;
+		case 'm': case 'M': value*=1024*1024; end++; break;
+		case 'g': case 'G': value*=1024*1024*1024; end++; break;
+	}
+
+	if (*end || value<=0)
+		return false;
+	size=static_cast<off_t>(value);
+	return true;
+}
+
+
+static void usage() {
+	std::cerr << "Usage: bench [-r reps] [-s size,...] [-t shape,...]" << std::endl
+		<< "       bench -g shape size" << std::endl
+		<< std::endl
+		<< "Shapes: wide, deep, list, string. Sizes accept k, m and g suffixes." << std::endl;
+}
+
+
+static std::vector<std::string> split(const char *arg) {
+	std::vector<std::string> result;
+	std::string buf(arg);
+	std::string::size_type start = 0, end;
+
+	while ((end=buf.find(',', start))!=std::string::npos) {
+		result.push_back(buf.substr(start, end-start));
+		start=end+1;
+	}
+	result.push_back(buf.substr(start));
+	return result;
+}
+
+
+int main(int argc, char **argv) {
+	std::vector<CorpusGenerator::shape_type> shapes;
+	std::vector<off_t> sizes;
+	unsigned int reps = 5;
+	bool generate = false;
+	int opt;
+
+	while ((opt=getopt(argc, argv, "gr:s:t:h"))!=-1)
+		switch (opt) {
+			case 'g':
+				generate=true;
+				break;
+
+			case 'r':
+				reps=atoi(optarg);
+				if (!reps) {
+					usage();
+					return 1;
+				}
+				break;
+
+			case 's':
+				{
+				std::vector<std::string> args = split(optarg);
+				for (std::vector<std::string>::const_iterator i=args.begin(); i!=args.end(); i++) {
+					off_t size;
+					if (!parsesize(i->c_str(), size)) {
+						usage();
+						return 1;
+					}
+					sizes.push_back(size);
+				}
+				break;
+				}
+
+			case 't':
+				{
+				std::vector<std::string> args = split(optarg);
+				for (std::vector<std::string>::const_iterator i=args.begin(); i!=args.end(); i++) {
+					CorpusGenerator::shape_type shape;
+					if (!CorpusGenerator::ParseShape(*i, shape)) {
+						usage();
+						return 1;
+					}
+					shapes.push_back(shape);
+				}
+				break;
+				}
+
+			default:
+				usage();
+				return 1;
+		}
+
+	if (generate) {
+		CorpusGenerator::shape_type shape;
+		off_t size;
+
+		if (argc-optind!=2 || !CorpusGenerator::ParseShape(argv[optind], shape) ||
+				!parsesize(argv[optind+1], size)) {
+			usage();
+			return 1;
+		}
+
+		CorpusGenerator gen(shape);
+		gen(std::cout, size);
+		return 0;
+	}
+
+	if (optind!=argc) {
+		usage();
+		return 1;
+	}
+
+	if (shapes.empty()) {
+		shapes.push_back(CorpusGenerator::Wide);
+		shapes.push_back(CorpusGenerator::Deep);
+		shapes.push_back(CorpusGenerator::ListHeavy);
+		shapes.push_back(CorpusGenerator::StringHeavy);
+	}
+	if (sizes.empty()) {
+		sizes.push_back(16*1024);
+		sizes.push_back(1024*1024);
+		sizes.push_back(16*1024*1024);
+	}
+
+	try {
+		for (std::vector<off_t>::const_iterator size=sizes.begin(); size!=sizes.end(); size++)
+			for (std::vector<CorpusGenerator::shape_type>::const_iterator shape=shapes.begin(); shape!=shapes.end(); shape++)
+				runbenchmarks(*shape, *size, reps);
+	} catch (const std::exception &e) {
+		std::cerr << "Benchmark failed: " << e.what() << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
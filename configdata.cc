@@ -3,72 +3,450 @@
  *
  * See COPYING for license information.
  */
+#include <algorithm>
+#include <new>
+#include <vector>
 #include "configdata.hh"
+#include "stats.hh"
+#include "memusage.hh"
+#include "parallel.hh"
+
+/* A map being merged. pos is the entry of other which is being merged,
+ * so the keys of all frames on the stack make up the current path. */
+struct MergeFrame {
+	MergeFrame(ConfigData *node, const ConfigData *other) : node(node), other(other), pos(other->mapValue.begin()), entered(false) { }
+
+	ConfigData				*node;
+	const ConfigData			*other;
+	ConfigData::map_type::const_iterator	pos;
+	bool					entered;	/*!< pos has been merged */
+};
+
 
 void ConfigData::Merge(const ConfigData &other, bool overwrite, bool typecheck) {
 	if (&other==this)
 		return;
 
+	STATS_TIMER(Merge);
+
+	// Maps are merged depth-first using an explicit stack, so deeply
+	// nested configurations can not overflow the call stack.
+	std::vector<MergeFrame> stack;
+	ConfigData *node = this;
+	const ConfigData *source = &other;
+
+	for (;;) {
+		STATS_ADD(mergeVisited, 1);
+
+		if (typecheck && node->type!=source->type) {
+			std::string context;
+			for (std::vector<MergeFrame>::const_iterator i=stack.begin(); i!=stack.end(); i++) {
+				if (i!=stack.begin())
+					context+='/';
+				context+=i->pos->first;
+			}
+			throw typemismatch_error(context);
+		}
+
+		if (overwrite || node->type==List)
+			node->Clear();
+
+		node->type=source->type;
+
+		switch (node->type) {
+			case Bogus:
+				break;
+
+			case Integer:
+				node->intValue=source->intValue;
+				break;
+
+			case String:
+				node->strValue=source->strValue;
+				break;
+
+			case List:
+				{
+				list_type::const_iterator li;
+
+				for (li=source->listValue.begin(); li!=source->listValue.end(); li++) {
+					node->listValue.push_back(*li);
+					MemoryUsage::TrackListEntry();
+				}
+				// packed lists are not modified, so they are shared
+				node->packed=source->packed;
+
+				break;
+				}
+
+			case Map:
+				stack.push_back(MergeFrame(node, source));
+				break;
+
+			default:
+				throw std::logic_error("Illegal data type encountered");
+		}
+
+		if (node!=this)
+			MemoryUsage::Track(*node);
+
+		// Find the next entry to merge.
+		node=0;
+		while (!stack.empty()) {
+			MergeFrame &frame = stack.back();
+
+			if (frame.entered)
+				++frame.pos;
+			frame.entered=true;
+
+			if (frame.pos==frame.other->mapValue.end()) {
+				stack.pop_back();
+				continue;
+			}
+
+			boost::shared_ptr<ConfigData> newvalue(new ConfigData(frame.pos->second->type));
+			STATS_ADD(mergeCopied, 1);
+			if (MemoryUsage::tracker && frame.node->mapValue.find(frame.pos->first)==frame.node->mapValue.end())
+				MemoryUsage::TrackEntry(frame.pos->first);
+			frame.node->mapValue[frame.pos->first]=newvalue;
+
+			node=newvalue.get();
+			source=frame.pos->second.get();
+			break;
+		}
+
+		if (!node)
+			break;
+	}
+}
+
+
+/* Maps with fewer entries than this are not worth merging in parallel. */
+static const size_t parallelMergeMinimum = 256;
+
+/* Work shared by the threads of a ParallelMerge. */
+struct ParallelMergeState {
+	/* A run of consecutive entries, copied by one thread. Copying
+	 * stops at the first failure. */
+	struct Chunk {
+		Chunk() : failed(false) { }
+
+		size_t		first, last;
+		bool		failed;
+		size_t		failure;	/*!< index of the failed entry */
+		enum { Mismatch, Logic, Allocation, Other } kind;
+		std::string	what;		/*!< message or type mismatch context */
+		MemoryUsage	usage;
+		ParseStats	stats;
+	};
+
+	std::vector<ConfigData::map_type::const_iterator>	entries;
+	std::vector<boost::shared_ptr<ConfigData> >		results;
+	std::vector<Chunk>					chunks;
+	bool	overwrite, typecheck;
+	bool	track;		/*!< the caller has a MemoryUsage tracker */
+	bool	stats;		/*!< the caller has a ParseStats collector */
+};
+
+
+static void ParallelMergeJob(void *context, size_t index) {
+	ParallelMergeState &state = *static_cast<ParallelMergeState*>(context);
+	ParallelMergeState::Chunk &chunk = state.chunks[index];
+	MemoryUsage *previousTracker = MemoryUsage::tracker;
+	ParseStats *previousStats = ParseStats::active;
+
+	MemoryUsage::tracker=state.track ? &chunk.usage : 0;
+	ParseStats::active=state.stats ? &chunk.stats : 0;
+
+	for (size_t i=chunk.first; i<chunk.last; i++) {
+		const ConfigData &source = *state.entries[i]->second;
+
+		try {
+			// The same steps Merge takes for a map entry. A map is
+			// tracked before its children, so it is counted even if
+			// merging one of them fails.
+			state.results[i].reset(new ConfigData(source.type));
+			STATS_ADD(mergeCopied, 1);
+			if (source.type==ConfigData::Map)
+				MemoryUsage::Track(*state.results[i]);
+			state.results[i]->Merge(source, state.overwrite, state.typecheck);
+			if (source.type!=ConfigData::Map)
+				MemoryUsage::Track(*state.results[i]);
+			continue;
+		} catch (typemismatch_error &e) {
+			e.AddContext(state.entries[i]->first);
+			chunk.kind=ParallelMergeState::Chunk::Mismatch;
+			chunk.what=e.context;
+		} catch (std::logic_error &e) {
+			chunk.kind=ParallelMergeState::Chunk::Logic;
+			chunk.what=e.what();
+		} catch (std::bad_alloc &) {
+			chunk.kind=ParallelMergeState::Chunk::Allocation;
+		} catch (std::exception &e) {
+			chunk.kind=ParallelMergeState::Chunk::Other;
+			chunk.what=e.what();
+		}
+		chunk.failed=true;
+		chunk.failure=i;
+		break;
+	}
+
+	MemoryUsage::tracker=previousTracker;
+	ParseStats::active=previousStats;
+}
+
+
+void ConfigData::ParallelMerge(const ConfigData &other, bool overwrite, bool typecheck, unsigned int threads) {
+	if (&other==this)
+		return;
+	if (!threads)
+		threads=ProcessorCount();
+	if (other.type!=Map || other.mapValue.size()<parallelMergeMinimum || threads==1) {
+		Merge(other, overwrite, typecheck);
+		return;
+	}
+
+	STATS_TIMER(Merge);
+	STATS_ADD(mergeVisited, 1);
+
 	if (typecheck && type!=other.type)
 		throw typemismatch_error();
-
 	if (overwrite || type==List)
 		Clear();
+	type=Map;
 
-	type=other.type;
+	ParallelMergeState state;
+	state.overwrite=overwrite;
+	state.typecheck=typecheck;
+	state.track=MemoryUsage::tracker!=0;
+	state.stats=ParseStats::active!=0;
+	state.entries.reserve(other.mapValue.size());
+	for (map_type::const_iterator i=other.mapValue.begin(); i!=other.mapValue.end(); i++)
+		state.entries.push_back(i);
+	state.results.resize(state.entries.size());
 
-	switch (type) {
-		case Bogus:
-			break;
+	// A few chunks per thread, so uneven subtrees balance out.
+	const size_t count = state.entries.size();
+	const size_t chunks = std::min(count, static_cast<size_t>(threads)*8);
+	state.chunks.resize(chunks);
+	for (size_t i=0; i<chunks; i++) {
+		state.chunks[i].first=count*i/chunks;
+		state.chunks[i].last=count*(i+1)/chunks;
+	}
 
-		case Integer:
-			intValue=other.intValue;
-			break;
+	ParallelFor(chunks, ParallelMergeJob, &state, threads);
 
-		case String:
-			strValue=other.strValue;
+	// Chunks cover consecutive entries, so the first failed chunk has
+	// the first failed entry. Merge would have stopped there.
+	size_t end = count;
+	const ParallelMergeState::Chunk *failed = 0;
+	for (std::vector<ParallelMergeState::Chunk>::const_iterator i=state.chunks.begin(); i!=state.chunks.end(); i++) {
+		if (state.track)
+			*MemoryUsage::tracker+=i->usage;
+		STATS_ADD(mergeVisited, i->stats.mergeVisited);
+		STATS_ADD(mergeCopied, i->stats.mergeCopied);
+		if (i->failed) {
+			failed=&*i;
+			end=i->failure+1;
 			break;
+		}
+	}
 
-		case List:
-			{
-			list_type::const_iterator li;
+	map_type::iterator hint = mapValue.begin();
+	for (size_t i=0; i<end; i++) {
+		const size_t size = mapValue.size();
+		hint=mapValue.insert(hint, map_type::value_type(state.entries[i]->first, state.results[i]));
+		if (mapValue.size()==size)
+			hint->second=state.results[i];
+		else
+			MemoryUsage::TrackEntry(state.entries[i]->first);
+		++hint;
+	}
 
-			for (li=other.listValue.begin(); li!=other.listValue.end(); li++)
-				listValue.push_back(*li);
+	if (failed) {
+		switch (failed->kind) {
+			case ParallelMergeState::Chunk::Mismatch:
+				throw typemismatch_error(failed->what);
+			case ParallelMergeState::Chunk::Logic:
+				throw std::logic_error(failed->what);
+			case ParallelMergeState::Chunk::Allocation:
+				throw std::bad_alloc();
+			default:
+				throw std::runtime_error(failed->what);
+		}
+	}
+}
 
-			break;
-			}
 
-		case Map:
-			{
-			map_type::const_iterator i;
-
-			for (i=other.mapValue.begin(); i!=other.mapValue.end(); i++)
-				try {
-					boost::shared_ptr<ConfigData> newvalue(new ConfigData(i->second->type));
-					newvalue->Merge(*i->second, overwrite, typecheck);
-					mapValue[i->first]=newvalue;
-				} catch (typemismatch_error e) {
-					e.AddContext(i->first);
-					throw e;
-				}
+/* Depth of nested Clear calls in this thread. */
+static __thread unsigned int clearDepth = 0;
 
+/* Nesting beyond which Clear stops releasing children recursively. */
+static const unsigned int clearDepthLimit = 256;
 
-			break; }
 
-		default:
-			throw std::logic_error("Illegal data type encountered");
-	}
+/* Move the children of a map or list which have children of their own
+ * to pending, so they can be released one at a time. */
+static void DetachChildren(ConfigData &node, std::vector<boost::shared_ptr<ConfigData> > &pending) {
+	if (node.type==ConfigData::Map) {
+		for (ConfigData::map_type::iterator i=node.mapValue.begin(); i!=node.mapValue.end(); i++)
+			if (i->second && (!i->second->mapValue.empty() || !i->second->listValue.empty())) {
+				pending.push_back(boost::shared_ptr<ConfigData>());
+				pending.back().swap(i->second);
+			}
+	} else
+		for (ConfigData::list_type::iterator i=node.listValue.begin(); i!=node.listValue.end(); i++)
+			if (*i && (!(*i)->mapValue.empty() || !(*i)->listValue.empty())) {
+				pending.push_back(boost::shared_ptr<ConfigData>());
+				pending.back().swap(*i);
+			}
 }
 
 
 void ConfigData::Clear() {
+	if ((type==Map || type==List) && clearDepth>=clearDepthLimit) {
+		// Releasing the children of a deeply nested node directly
+		// would continue destroying the tree recursively. Instead the
+		// subtrees are taken apart one level at a time, so destroying
+		// a node from here never recurses more than once.
+		std::vector<boost::shared_ptr<ConfigData> > pending;
+
+		DetachChildren(*this, pending);
+		while (!pending.empty()) {
+			boost::shared_ptr<ConfigData> child;
+
+			child.swap(pending.back());
+			pending.pop_back();
+			// shared subtrees are still in use elsewhere
+			if (child.unique())
+				DetachChildren(*child, pending);
+		}
+	}
+
+	clearDepth++;
 	if (type==Map) 
 		mapValue.clear();
-	else if (type==List)
+	else if (type==List) {
 		listValue.clear();
+		packed.reset();
+	}
 	else if (type==String)
 		strValue.clear();
+	clearDepth--;
 
 	type=Bogus;
 }
+
+
+PackedList::~PackedList() {
+	delete expanded;
+}
+
+
+const ConfigData::list_type &PackedList::Expanded() const {
+	if (expanded)
+		return *expanded;
+
+	ConfigData::list_type *list = new ConfigData::list_type;
+
+	list->reserve(size());
+	for (size_t i=0; i<size(); i++)
+		if (type==ConfigData::Integer)
+			list->push_back(boost::shared_ptr<ConfigData>(new ConfigData(integers[i])));
+		else {
+			size_t length;
+			const char *data = String(i, length);
+			list->push_back(boost::shared_ptr<ConfigData>(new ConfigData(std::string(data, length))));
+		}
+
+	// another thread may have been faster
+	if (!__sync_bool_compare_and_swap(&expanded, static_cast<ConfigData::list_type*>(0), list))
+		delete list;
+	return *expanded;
+}
+
+
+/* Copy a packed list which is shared, so it can be modified. */
+static void UnshareList(boost::shared_ptr<PackedList> &packed) {
+	if (packed.unique())
+		return;
+
+	boost::shared_ptr<PackedList> copy(new PackedList(packed->type));
+	copy->integers=packed->integers;
+	copy->strings=packed->strings;
+	copy->ends=packed->ends;
+	packed.swap(copy);
+}
+
+
+void ConfigData::Append(int value) {
+	if (type!=List)
+		throw type_error("list-style access on non-list data");
+
+	if (listValue.empty() && (!packed || packed->type==Integer)) {
+		if (packed)
+			UnshareList(packed);
+		else
+			packed.reset(new PackedList(Integer));
+		packed->Append(value);
+		MemoryUsage::TrackPackedEntry(sizeof(int));
+	} else {
+		boost::shared_ptr<ConfigData> node(new ConfigData(value));
+		MemoryUsage::Track(*node);
+		Append(node);
+	}
+}
+
+
+void ConfigData::Append(const char *data, size_t length) {
+	if (type!=List)
+		throw type_error("list-style access on non-list data");
+
+	if (listValue.empty() && (!packed || packed->type==String)) {
+		if (packed)
+			UnshareList(packed);
+		else
+			packed.reset(new PackedList(String));
+		packed->Append(data, length);
+		MemoryUsage::TrackPackedEntry(length+1+sizeof(size_t));
+	} else {
+		boost::shared_ptr<ConfigData> node(new ConfigData(std::string(data, length)));
+		MemoryUsage::Track(*node);
+		Append(node);
+	}
+}
+
+
+void ConfigData::Append(const boost::shared_ptr<ConfigData> &value) {
+	if (type!=List)
+		throw type_error("list-style access on non-list data");
+
+	Unpack();
+	MemoryUsage::TrackListEntry();
+	listValue.push_back(value);
+}
+
+
+void ConfigData::Unpack() {
+	if (!packed)
+		return;
+
+	boost::shared_ptr<PackedList> list;
+
+	list.swap(packed);
+	listValue.reserve(listValue.size()+list->size());
+	for (size_t i=0; i<list->size(); i++) {
+		boost::shared_ptr<ConfigData> value;
+
+		if (list->type==Integer)
+			value.reset(new ConfigData(list->integers[i]));
+		else {
+			size_t length;
+			const char *data = list->String(i, length);
+			value.reset(new ConfigData(std::string(data, length)));
+		}
+		MemoryUsage::Track(*value);
+		MemoryUsage::TrackListEntry();
+		listValue.push_back(value);
+	}
+}
@@ -11,8 +11,10 @@
 #include <string>
 #include <map>
 #include <stdexcept>
+#include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <cassert>
+#include "trace.hh"
 
 /** Access type errors.
  * An instance of this exception class is thrown you try to cast a ConfigData
@@ -59,6 +61,11 @@ public:
 };
 
 
+class PackedList;
+class IntegerSpan;
+class StringSpan;
+
+
 /** Configuration data container.
  * This class is used to store configuration settings. Configuration
  * data can be of many different types of data (numbers, strings, lists) 
@@ -138,6 +145,8 @@ public:
 	/** Clear out this bit of configuration space.
 	 *
 	 * Remove all stored values. This will also reset the type to Bogus.
+	 * Very deep subtrees are released level by level instead of
+	 * recursively, so destroying them can not overflow the stack.
 	 */
 	void Clear();
 
@@ -175,8 +184,10 @@ public:
 	 * \return integer value stored in this entry
 	 */
 	operator int() const {
+		TRACE_BEGIN();
 		if (type!=Integer)
 			throw type_error("integer-style access on non-integer data");
+		TRACE_END(this, Read);
 		return intValue;
 	}
 
@@ -189,8 +200,10 @@ public:
 	 * \return string value stored in this entry
 	 */
 	operator const char*() const {
+		TRACE_BEGIN();
 		if (type!=String)
 			throw type_error("string-style access on non-string data");
+		TRACE_END(this, Read);
 		return strValue.c_str();
 	}
 
@@ -204,8 +217,10 @@ public:
 	 * \return string value stored in this entry
 	 */
 	operator const std::string&() const {
+		TRACE_BEGIN();
 		if (type!=String)
 			throw type_error("string-style access on non-string data");
+		TRACE_END(this, Read);
 		return strValue;
 	}
 
@@ -218,24 +233,80 @@ public:
 	 * \return string value stored in this entry
 	 */
 	operator std::string&() {
+		TRACE_BEGIN();
 		if (type!=String)
 			throw type_error("string-style access on non-string data");
+		TRACE_END(this, Read);
 		return strValue;
 	}
 
 	/** Array access operator.
 	 * If a configuration entry contains a list of values you can easily
-	 * access it using this operator. For more specific list access
-	 * please use the listValue member directly.
+	 * access it using this operator. For more specific list access use
+	 * ListSize(), Entries(), or Integers() and Strings() for packed
+	 * lists.
+	 *
+	 * Indexing a packed list creates a ConfigData node for every entry
+	 * of the list and keeps them, which costs far more memory than the
+	 * packed form. Use Integers() or Strings() on hot paths and for
+	 * large lists.
 	 *
 	 * \return reference to a configuration entry in the list
 	 */
 	const ConfigData& operator[](int index) const {
+		TRACE_BEGIN();
 		if (type!=List)
 			throw type_error("list-style access on non-list data");
-		return *listValue[index];
+		const list_type &entries = Entries();
+		TRACE_END(entries[index].get(), Lookup);
+		return *entries[index];
 	}
 
+	/** Return the number of entries in a list. */
+	size_t ListSize() const;
+
+	/** Return the entries of a list.
+	 * For a packed list ConfigData entries are created the first time
+	 * this is called and kept until the list is cleared or appended to,
+	 * which invalidates the returned entries. Calling this from several
+	 * threads which only read the same list is safe.
+	 */
+	const list_type &Entries() const;
+
+	/** Return the entries of a packed list of integers.
+	 * A type_error is thrown if this is not a packed integer list.
+	 */
+	IntegerSpan Integers() const;
+
+	/** Return the entries of a packed list of strings.
+	 * A type_error is thrown if this is not a packed string list.
+	 */
+	StringSpan Strings() const;
+
+	/** Check if this is a packed list. */
+	bool IsPacked() const { return packed.get()!=0; }
+
+	/** Add an integer to a list.
+	 * Lists which only contain integers are stored packed.
+	 */
+	void Append(int value);
+
+	/** Add a string to a list.
+	 * Lists which only contain strings are stored packed.
+	 */
+	void Append(const char *data, size_t length);
+
+	/** Add an entry to a list.
+	 * A packed list is unpacked first.
+	 */
+	void Append(const boost::shared_ptr<ConfigData> &value);
+
+	/** Convert a packed list to the generic form.
+	 * The entries are moved to listValue, which can then be modified
+	 * freely.
+	 */
+	void Unpack();
+
 	/** Map access operator.
 	 * If a configuration entry contains a new configuration section
 	 * one can access it using this operator. For more specific map access
@@ -244,11 +315,13 @@ public:
 	 * \return reference to a configuration entry in the subsection
 	 */
 	const ConfigData& operator[](const char *index) const {
+		TRACE_BEGIN();
 		if (type!=Map)
 			throw type_error("list-style access on non-list data");
 		const map_type::const_iterator i = mapValue.find(index);
 		if (i==mapValue.end())
 			throw std::range_error("Key not found");
+		TRACE_END(i->second.get(), Lookup);
 		return *i->second;
 	}
 
@@ -261,11 +334,13 @@ public:
 	 * \return reference to a configuration entry in the subsection
 	 */
 	const ConfigData& operator[](const std::string &index) const {
+		TRACE_BEGIN();
 		if (type!=Map)
 			throw type_error("list-style access on non-list data");
 		const map_type::const_iterator i = mapValue.find(index);
 		if (i==mapValue.end())
 			throw std::range_error("Key not found");
+		TRACE_END(i->second.get(), Lookup);
 		return *i->second;
 	}
 
@@ -277,12 +352,35 @@ public:
 	 * exception will be thrown if a value has a different type in the 
 	 * a different type than the original.
 	 *
+	 * Nested maps are merged using an explicit stack, so the depth of
+	 * the configuration is not limited by the size of the call stack.
+	 *
 	 * \param other Data to merge into this instance.
 	 * \param overwrite overwrite existing values when merging.
 	 * \param typecheck insist value types match when overwriting.
 	 */
 	void Merge(const ConfigData &other, bool overwrite=false, bool typecheck=true);
 
+	/** Merge config data using several threads.
+	 * Behaves exactly like Merge, but when \a other is a wide map its
+	 * entries are copied by a number of threads. The result, the
+	 * MemoryUsage and ParseStats counters and any exception thrown are
+	 * the same as for Merge: if copying several entries fails the
+	 * error for the first one in key order is reported, after the
+	 * entries before it have been merged.
+	 *
+	 * Only the entries of \a other itself are divided between threads.
+	 * To merge a wide map deeper in the tree call this function on that
+	 * map. Narrow maps and other types are merged by Merge.
+	 *
+	 * \param other Data to merge into this instance.
+	 * \param overwrite overwrite existing values when merging.
+	 * \param typecheck insist value types match when overwriting.
+	 * \param threads maximum number of threads to use, including the
+	 * 	calling thread. 0 means one per processor.
+	 */
+	void ParallelMerge(const ConfigData &other, bool overwrite=false, bool typecheck=true, unsigned int threads=0);
+
 	/** Merge another configuration space into this one.
 	 * This operator merges another configuration space into another
 	 * one, overwriting any already existing values.
@@ -310,9 +408,161 @@ public:
 	int		intValue;	/*!< integer value storage */
 	std::string	strValue;	/*!< string value storage */
 	map_type	mapValue;	/*!< map value storage */
-	list_type	listValue;	/*!< list value storage */
+	list_type	listValue;	/*!< list value storage, empty for packed lists; only use it directly after Unpack() */
+	/** Packed storage of a list whose entries are all integers or all
+	 * strings. Packed lists may be shared and must not be modified;
+	 * use Unpack() first.
+	 */
+	boost::shared_ptr<PackedList>	packed;
 };
 
 
+/** Packed list storage.
+ * Integers are stored in a single array. Strings are stored back to back,
+ * each followed by a NUL byte, with the end of every string in a second
+ * array. This costs a few bytes per entry instead of a ConfigData node, a
+ * shared pointer and its control block.
+ */
+class PackedList : public boost::noncopyable {
+public:
+	/** Constructor.
+	 * \param type type of the entries, ConfigData::Integer or
+	 * 	ConfigData::String
+	 */
+	explicit PackedList(ConfigData::data_type type) : type(type), expanded(0) { }
+	~PackedList();
+
+	/** Return the number of entries. */
+	size_t size() const {
+		return type==ConfigData::Integer ? integers.size() : ends.size();
+	}
+
+	/** Add an integer.
+	 * Entries returned by Expanded() before are no longer valid.
+	 */
+	void Append(int value) {
+		Modified();
+		integers.push_back(value);
+	}
+
+	/** Add a string.
+	 * Entries returned by Expanded() before are no longer valid.
+	 */
+	void Append(const char *data, size_t length) {
+		Modified();
+		strings.append(data, length);
+		ends.push_back(strings.size());
+		strings+='\0';
+	}
+
+	/** Return a string entry.
+	 * \param index index of the entry
+	 * \param length set to the length of the string
+	 * \return start of the NUL-terminated string
+	 */
+	const char *String(size_t index, size_t &length) const {
+		const size_t start = index ? ends[index-1]+1 : 0;
+
+		length=ends[index]-start;
+		return strings.data()+start;
+	}
+
+	/** Return the entries as ConfigData nodes, creating them once. */
+	const ConfigData::list_type &Expanded() const;
+
+	/** Return the entries as ConfigData nodes if Expanded() has created
+	 * them, or 0 otherwise.
+	 */
+	const ConfigData::list_type *Cached() const { return expanded; }
+
+	const ConfigData::data_type	type;		/*!< type of the entries */
+	std::vector<int>		integers;	/*!< integer entries */
+	std::string			strings;	/*!< string entries, each followed by NUL */
+	std::vector<size_t>		ends;		/*!< end of every string entry */
+
+protected:
+	/** Drop the expanded entries, which no longer match. */
+	void Modified() {
+		delete expanded;
+		expanded=0;
+	}
+
+	mutable ConfigData::list_type	*expanded;	/*!< entries as nodes, if created */
+};
+
+
+/** Read-only view of a packed integer list. */
+class IntegerSpan {
+public:
+	IntegerSpan(const int *data, size_t length) : first(data), last(data+length) { }
+
+	const int *begin() const { return first; }
+	const int *end() const { return last; }
+	size_t size() const { return last-first; }
+	bool empty() const { return first==last; }
+	int operator[](size_t index) const { return first[index]; }
+
+private:
+	const int	*first, *last;
+};
+
+
+/** Read-only view of a packed string list. */
+class StringSpan {
+public:
+	explicit StringSpan(const PackedList &list) : list(&list) { }
+
+	size_t size() const { return list->size(); }
+	bool empty() const { return !list->size(); }
+
+	/** Return a NUL-terminated entry. */
+	const char *c_str(size_t index) const {
+		size_t length;
+		return list->String(index, length);
+	}
+
+	/** Return the length of an entry. */
+	size_t length(size_t index) const {
+		size_t length;
+		list->String(index, length);
+		return length;
+	}
+
+	/** Return a copy of an entry. */
+	std::string operator[](size_t index) const {
+		size_t length;
+		const char *data = list->String(index, length);
+		return std::string(data, length);
+	}
+
+private:
+	const PackedList	*list;
+};
+
+
+inline size_t ConfigData::ListSize() const {
+	return packed ? packed->size() : listValue.size();
+}
+
+
+inline const ConfigData::list_type &ConfigData::Entries() const {
+	return packed ? packed->Expanded() : listValue;
+}
+
+
+inline IntegerSpan ConfigData::Integers() const {
+	if (!packed || packed->type!=Integer)
+		throw type_error("integer list access on other data");
+	return IntegerSpan(packed->integers.empty() ? 0 : &packed->integers[0], packed->integers.size());
+}
+
+
+inline StringSpan ConfigData::Strings() const {
+	if (!packed || packed->type!=String)
+		throw type_error("string list access on other data");
+	return StringSpan(*packed);
+}
+
+
 #endif
 
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <cstdio>
+#include "corpus.hh"
+
+
+unsigned int CorpusGenerator::random() {
+	// xorshift32: fast, reproducible and good enough for test data
+	state^=state<<13;
+	state^=state>>17;
+	state^=state<<5;
+	return state;
+}
+
+
+std::string CorpusGenerator::word(unsigned int min, unsigned int max) {
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+	unsigned int len = min + random()%(max-min+1);
+	std::string result;
+
+	result.reserve(len);
+	for (unsigned int i=0; i<len; i++)
+		result+=letters[random()%26];
+	return result;
+}
+
+
+std::string CorpusGenerator::keyword(const char *prefix) {
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "_%lu", serial++);
+	return prefix + word(2, 8) + buf;
+}
+
+
+std::string CorpusGenerator::quoted(unsigned int min, unsigned int max) {
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789/.,=:- ";
+	unsigned int len = min + random()%(max-min+1);
+	std::string result;
+
+	result.reserve(len+2);
+	result+='"';
+	for (unsigned int i=0; i<len; i++)
+		result+=chars[random()%(sizeof(chars)-1)];
+	result+='"';
+	return result;
+}
+
+
+void CorpusGenerator::nest(std::string &buf, unsigned int depth, unsigned int indent) {
+	std::string tabs(indent, '\t');
+
+	buf+=tabs + keyword("level") + " {\n";
+	buf+=tabs + "\tname\t" + quoted(4, 16) + ";\n";
+	if (depth>1)
+		nest(buf, depth-1, indent+1);
+	else {
+		char num[16];
+		snprintf(num, sizeof(num), "%u", random()%65536);
+		buf+=tabs + "\tvalue\t" + num + ";\n";
+	}
+	buf+=tabs + "};\n";
+}
+
+
+std::string CorpusGenerator::section() {
+	std::string buf;
+	char num[32];
+
+	switch (shape) {
+		case Wide:
+			{
+			unsigned int keys = 2 + random()%6;
+
+			buf+=keyword("section") + " {\n";
+			for (unsigned int i=0; i<keys; i++) {
+				buf+="\t" + keyword("key") + "\t";
+				if (random()%2) {
+					snprintf(num, sizeof(num), "%u", random()%100000);
+					buf+=num;
+				} else
+					buf+=quoted(4, 24);
+				buf+=";\n";
+			}
+			buf+="};\n\n";
+			break;
+			}
+
+		case Deep:
+			nest(buf, 16 + random()%48, 0);
+			buf+="\n";
+			break;
+
+		case ListHeavy:
+			{
+			unsigned int items = 64 + random()%448;
+
+			buf+=keyword("acl") + " {\n";
+			buf+="\tmembers {\n";
+			for (unsigned int i=0; i<items; i++) {
+				if (random()%4==0) {
+					snprintf(num, sizeof(num), "%u", random()%65536);
+					buf+=std::string("\t\t") + num + ";\n";
+				} else {
+					snprintf(num, sizeof(num), "\"%u.%u.%u.%u/%u\"",
+							random()%256, random()%256,
+							random()%256, random()%256,
+							8 + random()%25);
+					buf+=std::string("\t\t") + num + ";\n";
+				}
+			}
+			buf+="\t};\n};\n\n";
+			break;
+			}
+
+		case StringHeavy:
+			buf+=keyword("blob") + " {\n";
+			buf+="\tdescription\t" + quoted(256, 4096) + ";\n";
+			buf+="\tlocation\t" + quoted(32, 256) + ";\n";
+			buf+="};\n\n";
+			break;
+	}
+
+	return buf;
+}
+
+
+off_t CorpusGenerator::operator()(std::ostream &out, off_t size) {
+	off_t written = 0;
+
+	while (written<size) {
+		std::string buf = section();
+		out.write(buf.data(), buf.size());
+		written+=buf.size();
+	}
+
+	return written;
+}
+
+
+bool CorpusGenerator::ParseShape(const std::string &name, shape_type &shape) {
+	if (name=="wide")
+		shape=Wide;
+	else if (name=="deep")
+		shape=Deep;
+	else if (name=="list")
+		shape=ListHeavy;
+	else if (name=="string")
+		shape=StringHeavy;
+	else
+		return false;
+	return true;
+}
+
+
+const char *CorpusGenerator::ShapeName(shape_type shape) {
+	switch (shape) {
+		case Wide:		return "wide";
+		case Deep:		return "deep";
+		case ListHeavy:		return "list";
+		case StringHeavy:	return "string";
+	}
+	return "unknown";
+}
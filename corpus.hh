@@ -0,0 +1,82 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_corpus_included__
+#define __wta_corpus_included__
+
+#include <ostream>
+#include <string>
+#include <sys/types.h>
+
+/** Synthetic ISC configuration generator.
+ *
+ * Produces reproducible ISC style configuration files of a requested
+ * size and shape. It is used by the benchmark suite but can also be used
+ * to create large inputs for other testing purposes. The output is always
+ * accepted by ISCParser.
+ */
+class CorpusGenerator {
+public:
+	/** Shape of the generated configuration. */
+	enum shape_type {
+		Wide,		/*!< many top-level sections with a few values each */
+		Deep,		/*!< deeply nested sections */
+		ListHeavy,	/*!< sections containing long lists of values */
+		StringHeavy,	/*!< few keys with long string values */
+	};
+
+	/** Standard constructor.
+	 * \param shape shape of the configuration to generate
+	 * \param seed seed for the pseudo random generator
+	 */
+	explicit CorpusGenerator(shape_type shape, unsigned int seed=1) :
+		shape(shape), state(seed ? seed : 1), serial(0) { }
+
+	/** Write a configuration.
+	 * Writes top-level sections to \a out until at least \a size bytes
+	 * have been produced.
+	 *
+	 * \param out stream to write to
+	 * \param size minimum number of bytes to produce
+	 * \return number of bytes written
+	 */
+	off_t operator()(std::ostream &out, off_t size);
+
+	/** Convert a shape name to a shape.
+	 * \param name one of wide, deep, list or string
+	 * \param shape set to the matching shape
+	 * \return true if the name was recognized
+	 */
+	static bool ParseShape(const std::string &name, shape_type &shape);
+
+	/** Return the name of a shape. */
+	static const char *ShapeName(shape_type shape);
+
+protected:
+	/** Return the next pseudo random number. */
+	unsigned int random();
+
+	/** Generate a random word of \a min to \a max characters. */
+	std::string word(unsigned int min, unsigned int max);
+
+	/** Generate a unique keyword. */
+	std::string keyword(const char *prefix);
+
+	/** Generate a quoted string of \a min to \a max characters. */
+	std::string quoted(unsigned int min, unsigned int max);
+
+	/** Generate a single top-level section. */
+	std::string section();
+
+	/** Generate a nested section \a depth levels deep. */
+	void nest(std::string &buf, unsigned int depth, unsigned int indent);
+
+	shape_type	shape;	/*!< shape being generated */
+	unsigned int	state;	/*!< pseudo random generator state */
+	unsigned long	serial;	/*!< counter used to create unique keys */
+};
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <stdexcept>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "decompress.hh"
+#include "tokenize.hh"
+
+
+Decompressor::compression_type Decompressor::Detect(const char *data, size_t length) {
+	const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+
+	if (length>=2 && p[0]==0x1f && p[1]==0x8b)
+		return Gzip;
+	if (length>=4 && p[0]==0x28 && p[1]==0xb5 && p[2]==0x2f && p[3]==0xfd)
+		return Zstd;
+	return None;
+}
+
+
+namespace {
+
+class GzipDecompressor : public Decompressor {
+public:
+	GzipDecompressor(const char *data, size_t length) : done(false) {
+		memset(&stream, 0, sizeof(stream));
+		// 16+: expect a gzip header
+		if (inflateInit2(&stream, 16+MAX_WBITS)!=Z_OK)
+			throw std::runtime_error("can not initialize zlib");
+		stream.next_in=reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		remaining=length;
+	}
+
+	virtual ~GzipDecompressor() {
+		inflateEnd(&stream);
+	}
+
+	virtual size_t Read(char *buffer, size_t size) {
+		stream.next_out=reinterpret_cast<Bytef*>(buffer);
+		stream.avail_out=0;
+
+		while (!done && size) {
+			// zlib counts in unsigned int
+			if (!stream.avail_in) {
+				stream.avail_in=remaining<(1u<<30) ? remaining : (1u<<30);
+				remaining-=stream.avail_in;
+			}
+			stream.avail_out=size<(1u<<30) ? size : (1u<<30);
+			size-=stream.avail_out;
+
+			int r = inflate(&stream, Z_NO_FLUSH);
+			size+=stream.avail_out;
+
+			if (r==Z_STREAM_END) {
+				// another member may follow
+				if (stream.avail_in || remaining)
+					inflateReset(&stream);
+				else
+					done=true;
+			} else if (r==Z_BUF_ERROR && !stream.avail_in && !remaining)
+				throw EofError();
+			else if (r!=Z_OK && r!=Z_BUF_ERROR)
+				throw std::runtime_error(stream.msg ? stream.msg : "corrupt gzip data");
+		}
+
+		return reinterpret_cast<char*>(stream.next_out)-buffer;
+	}
+
+protected:
+	z_stream	stream;
+	size_t		remaining;	/*!< input not yet handed to zlib */
+	bool		done;
+};
+
+
+#ifdef HAVE_ZSTD
+class ZstdDecompressor : public Decompressor {
+public:
+	ZstdDecompressor(const char *data, size_t length) : stream(ZSTD_createDStream()), pending(0) {
+		if (!stream)
+			throw std::bad_alloc();
+		ZSTD_initDStream(stream);
+		in.src=data;
+		in.size=length;
+		in.pos=0;
+	}
+
+	virtual ~ZstdDecompressor() {
+		ZSTD_freeDStream(stream);
+	}
+
+	virtual size_t Read(char *buffer, size_t size) {
+		ZSTD_outBuffer out = { buffer, size, 0 };
+
+		while (out.pos<out.size) {
+			if (in.pos==in.size && !pending)
+				break;
+
+			size_t r = ZSTD_decompressStream(stream, &out, &in);
+			if (ZSTD_isError(r))
+				throw std::runtime_error(ZSTD_getErrorName(r));
+			pending=r;
+
+			// a frame is incomplete and there is no more input
+			if (pending && in.pos==in.size && out.pos<out.size)
+				throw EofError();
+		}
+
+		return out.pos;
+	}
+
+protected:
+	ZSTD_DStream	*stream;
+	ZSTD_inBuffer	in;
+	size_t		pending;	/*!< non-zero while inside a frame */
+};
+#endif
+
+}
+
+
+boost::shared_ptr<Decompressor> Decompressor::Create(compression_type type, const char *data, size_t length) {
+	switch (type) {
+		case Gzip:
+			return boost::shared_ptr<Decompressor>(new GzipDecompressor(data, length));
+
+		case Zstd:
+#ifdef HAVE_ZSTD
+			return boost::shared_ptr<Decompressor>(new ZstdDecompressor(data, length));
+#else
+			throw std::runtime_error("zstd compressed input is not supported");
+#endif
+
+		default:
+			throw std::logic_error("unknown compression format");
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_decompress_included__
+#define __wta_decompress_included__
+
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+
+/** Decompressing reader for compressed input in memory.
+ *
+ * gzip input is always supported. zstd input is supported when the
+ * library is compiled with HAVE_ZSTD defined and linked with libzstd.
+ * Concatenated gzip members and zstd frames are decompressed as one
+ * stream.
+ *
+ * Errors in the compressed data throw std::runtime_error; input which
+ * ends in the middle of a stream throws EofError.
+ */
+class Decompressor : public boost::noncopyable {
+public:
+	/** Compression formats. */
+	enum compression_type {
+		None,	/*!< not compressed */
+		Gzip,	/*!< gzip (RFC 1952) */
+		Zstd	/*!< zstd (RFC 8878) */
+	};
+
+	virtual ~Decompressor() { }
+
+	/** Detect the compression format from the magic bytes.
+	 * \param data start of the input
+	 * \param length size of the input
+	 */
+	static compression_type Detect(const char *data, size_t length);
+
+	/** Create a decompressor.
+	 * \param type compression format of the input
+	 * \param data compressed input; it is not copied and must stay valid
+	 * 	while the decompressor is used
+	 * \param length size of the compressed input
+	 */
+	static boost::shared_ptr<Decompressor> Create(compression_type type, const char *data, size_t length);
+
+	/** Decompress the next part of the input.
+	 * Fills \a buffer unless the end of the input is reached first.
+	 *
+	 * \param buffer buffer receiving decompressed data
+	 * \param size size of the buffer
+	 * \return number of bytes stored; 0 at the end of the input
+	 */
+	virtual size_t Read(char *buffer, size_t size) = 0;
+};
+
+#endif
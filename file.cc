@@ -7,16 +7,17 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include "file.hh"
+#include "stats.hh"
 
 
 void File::open(const char *name, File::flags_type flags) {
 	if (fileno!=-1)
 		throw std::logic_error("opening an already open File");
 
-	if ((fileno=::open(name, flags))==-1)
+	if ((fileno=::open(name, flags, 0666))==-1)
 		throw system_exception(name);
 
-	name=name;
+	this->name=name;
 }
 
 
@@ -49,29 +50,172 @@ File::~File() {
 }
 
 
-void MemoryFile::open(const char *name, File::flags_type flags) {
+BufferPool::BufferPool() {
+	pthread_mutex_init(&lock, 0);
+}
+
+
+BufferPool::~BufferPool() {
+	purge();
+	pthread_mutex_destroy(&lock);
+}
+
+
+BufferPool& BufferPool::instance() {
+	static BufferPool pool;
+	return pool;
+}
+
+
+char *BufferPool::acquire(size_t size, size_t &capacity) {
+	unsigned int sclass = 0;
+
+	capacity=minSize;
+	while (capacity<size && sclass<classes) {
+		capacity<<=1;
+		sclass++;
+	}
+
+	if (sclass==classes) {
+		capacity=size;
+		return new char[size];
+	}
+
+	pthread_mutex_lock(&lock);
+	if (!free[sclass].empty()) {
+		char *buffer = free[sclass].back();
+		free[sclass].pop_back();
+		pthread_mutex_unlock(&lock);
+		return buffer;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return new char[capacity];
+}
+
+
+void BufferPool::release(char *buffer, size_t capacity) {
+	unsigned int sclass = 0;
+	size_t csize = minSize;
+
+	while (csize<capacity && sclass<classes) {
+		csize<<=1;
+		sclass++;
+	}
+
+	if (sclass<classes && csize==capacity) {
+		pthread_mutex_lock(&lock);
+		if (free[sclass].size()<maxCached) {
+			free[sclass].push_back(buffer);
+			buffer=0;
+		}
+		pthread_mutex_unlock(&lock);
+	}
+
+	delete[] buffer;
+}
+
+
+void BufferPool::purge() {
+	pthread_mutex_lock(&lock);
+	for (unsigned int i=0; i<classes; i++) {
+		for (std::vector<char*>::iterator b=free[i].begin(); b!=free[i].end(); b++)
+			delete[] *b;
+		free[i].clear();
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+
+off_t MemoryFile::mapThreshold = 64*1024;
+off_t MemoryFile::largeThreshold = 2*1024*1024;
+
+
+void MemoryFile::open(const char *name, File::flags_type flags, strategy_type how) {
 	if (data)
 		throw std::logic_error("opening an already open MemoryFile");
 
+	STATS_TIMER(Load);
 	File fd(name, flags);
+
+	if (how==Auto) {
+		if ((flags==File::ReadOnly || flags==File::ReadWrite) && fd.size()<mapThreshold)
+			how=Buffered;
+		else
+			how=Mapped;
+	}
+
+	if (how==Buffered)
+		read(fd);
+	else
+		map(fd, flags);
+
+	strategy=how;
+	STATS_ADD(bytesLoaded, size);
+}
+
+
+void MemoryFile::map(File &fd, File::flags_type flags) {
 	int mapflags = 0;
+	int prot = 0;
 
 	if (flags==File::ReadOnly)
-		mapflags=PROT_READ;
+		prot=PROT_READ;
 	else if (flags==File::WriteOnly)
-		mapflags=PROT_WRITE;
+		prot=PROT_WRITE;
 	else if (flags==File::ReadWrite)
-		mapflags=PROT_READ|PROT_WRITE;
+		prot=PROT_READ|PROT_WRITE;
 	else
-		mapflags=PROT_NONE;
+		prot=PROT_NONE;
+
+	mapflags=MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	if (fd.size()>=largeThreshold)
+		mapflags|=MAP_POPULATE;
+#endif
 
-	
 	size=fd.size();
-	data=reinterpret_cast<char*>(mmap(0, fd.size(),
-				mapflags, MAP_PRIVATE, fd.fileno, 0));
+	data=reinterpret_cast<char*>(mmap(0, size, prot, mapflags, fd.fileno, 0));
 
-	if (data==MAP_FAILED)
-		throw system_exception();
+	if (data==MAP_FAILED) {
+		data=0;
+		size=0;
+		throw system_exception(fd.name);
+	}
+
+	// Access hints are advisory: failures are not worth reporting.
+	madvise(data, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	if (size>=largeThreshold)
+		madvise(data, size, MADV_HUGEPAGE);
+#endif
+}
+
+
+void MemoryFile::read(File &fd) {
+	if (fd.size()<0 || static_cast<unsigned long long>(fd.size())>static_cast<size_t>(-1))
+		throw std::length_error("file too large to read into memory");
+
+	size_t want = static_cast<size_t>(fd.size());
+	size_t got = 0;
+	char *buffer = BufferPool::instance().acquire(want, capacity);
+
+	while (got<want) {
+		ssize_t len = ::read(fd.fileno, buffer+got, want-got);
+
+		if (len==-1 && errno==EINTR)
+			continue;
+		if (len<=0) {
+			int err = len==0 ? EIO : errno;
+			BufferPool::instance().release(buffer, capacity);
+			capacity=0;
+			throw system_exception(fd.name, err);
+		}
+		got+=len;
+	}
+
+	data=buffer;
+	size=fd.size();
 }
 
 
@@ -86,7 +230,12 @@ void MemoryFile::close() {
 	if (!data)
 		throw std::logic_error("Closing an already closed MemoryFile");
 
-	if (munmap(data, size)==-1)
+	if (strategy==Buffered) {
+		BufferPool::instance().release(data, capacity);
+		capacity=0;
+	} else if (munmap(data, size)==-1)
 		throw system_exception();
-}
 
+	data=0;
+	size=0;
+}
@@ -14,6 +14,8 @@
 #include <cstring>
 #include <stdexcept>
 #include <string>
+#include <vector>
+#include <pthread.h>
 #include <boost/noncopyable.hpp>
 
 /** System exception.
@@ -52,11 +54,13 @@ public:
 	enum flags_type {
 		ReadOnly = O_RDONLY,	/*!< read-only mode */
 		WriteOnly = O_WRONLY,	/*!< write-only mode */
-		ReadWrite = O_RDWR	/*!< read & write mode */
+		ReadWrite = O_RDWR,	/*!< read & write mode */
+		Create = O_WRONLY|O_CREAT|O_TRUNC	/*!< create or truncate for writing */
 	};
 
 	/** Default constructor.
-	 * Opens a (existing) file.
+	 * Opens a file. Unless the Create access type is used the file must
+	 * already exist.
 	 * \param name pathname of file to open
 	 * \param flags file access type
 	 */
@@ -104,19 +108,74 @@ protected:
 };
 
 
+/** Pool of reusable read buffers.
+ * Small files are read into a buffer instead of being mapped. To avoid
+ * hitting the allocator for every file those buffers are recycled through
+ * this pool. Buffers are kept in power-of-two size classes; requests larger
+ * than the biggest class are allocated and freed directly.
+ *
+ * All methods are thread-safe.
+ */
+class BufferPool : public boost::noncopyable {
+public:
+	BufferPool();
+	~BufferPool();
+
+	/** Return the process-wide buffer pool. */
+	static BufferPool& instance();
+
+	/** Get a buffer.
+	 * \param size minimum number of bytes needed
+	 * \param capacity set to the real size of the returned buffer
+	 * \return buffer of at least \a size bytes
+	 */
+	char *acquire(size_t size, size_t &capacity);
+
+	/** Return a buffer to the pool.
+	 * \param buffer buffer obtained from acquire()
+	 * \param capacity capacity as returned by acquire()
+	 */
+	void release(char *buffer, size_t capacity);
+
+	/** Free all cached buffers. */
+	void purge();
+
+	static const size_t minSize = 4096;		/*!< smallest size class */
+	static const unsigned int classes = 9;		/*!< number of size classes (4 KiB - 1 MiB) */
+	static const unsigned int maxCached = 16;	/*!< buffers kept per size class */
+
+private:
+	pthread_mutex_t	lock;
+	std::vector<char*> free[classes];
+};
+
+
 /** Memory mapped file.
  * This class allows one to access the content of a file as normally
- * memory. This is done internally by using mmap. No file descriptor
- * is kept open.
+ * memory. No file descriptor is kept open.
+ *
+ * Depending on the file size the contents are either mapped using mmap
+ * or read into a pooled buffer. Mapping has a fixed setup and teardown
+ * cost which dominates for small files, while large files benefit from
+ * not being copied. The strategy is picked automatically but can be
+ * forced by the caller.
  */
 class MemoryFile : public boost::noncopyable {
 public:
+	/** Ways to get at the file contents. */
+	enum strategy_type {
+		Auto,		/*!< pick based on file size and access type */
+		Mapped,		/*!< use mmap */
+		Buffered	/*!< read() into a pooled buffer */
+	};
+
 	/** Default constructor.
 	 * \param name path of file to read
 	 * \param flags desired access type
+	 * \param how method used to get at the file contents
 	 */
-	MemoryFile(const char *name, File::flags_type flags=File::ReadOnly) : data(0), size(0) {
-		open(name, flags);
+	MemoryFile(const char *name, File::flags_type flags=File::ReadOnly, strategy_type how=Auto) : data(0), size(0), strategy(Auto), capacity(0) {
+		open(name, flags, how);
 	}
 
 
@@ -127,8 +186,9 @@ public:
 	 * file while an already opened.
 	 * \param name pathname of file to open
 	 * \param flags file access type
+	 * \param how method used to get at the file contents
 	 */
-	void open(const char *name, File::flags_type flags=File::ReadOnly);
+	void open(const char *name, File::flags_type flags=File::ReadOnly, strategy_type how=Auto);
 
 	/** Close a file.
 	 * Closes an open file. If closing fails a system_error
@@ -136,8 +196,23 @@ public:
 	 */
 	virtual void close();
 
-	char *data;	/*!< pointer to file contents */
-	off_t size;	/*!< file size */
+	char *data;		/*!< pointer to file contents */
+	off_t size;		/*!< file size */
+	strategy_type strategy;	/*!< strategy used for the open file */
+
+	/** Files smaller than this are read instead of mapped in Auto mode. */
+	static off_t mapThreshold;
+	/** Mapped files at least this large are prefaulted and get huge page hints. */
+	static off_t largeThreshold;
+
+protected:
+	/** Map the contents of an open file. */
+	void map(File &fd, File::flags_type flags);
+
+	/** Read the contents of an open file into a pooled buffer. */
+	void read(File &fd);
+
+	size_t capacity;	/*!< size of the pooled buffer when Buffered */
 };
 
 #endif
@@ -0,0 +1,373 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "frozen.hh"
+
+
+static inline uint64_t load64(const char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+uint64_t FrozenConfig::Hash(const char *data, size_t length, uint64_t seed) {
+	uint64_t h = seed ^ (length*0x9e3779b97f4a7c15ULL);
+
+	while (length>=8) {
+		h=(h ^ load64(data)) * 0xbf58476d1ce4e5b9ULL;
+		h^=h>>29;
+		data+=8;
+		length-=8;
+	}
+	if (length) {
+		uint64_t v = 0;
+		memcpy(&v, data, length);
+		h=(h ^ v) * 0x94d049bb133111ebULL;
+		h^=h>>32;
+	}
+
+	// final avalanche from splitmix64
+	h^=h>>30;
+	h*=0xbf58476d1ce4e5b9ULL;
+	h^=h>>27;
+	h*=0x94d049bb133111ebULL;
+	h^=h>>31;
+	return h;
+}
+
+
+struct BucketSizeGreater {
+	explicit BucketSizeGreater(const std::vector<std::vector<uint32_t> > &buckets) : buckets(buckets) { }
+
+	bool operator()(uint32_t a, uint32_t b) const {
+		if (buckets[a].size()!=buckets[b].size())
+			return buckets[a].size()>buckets[b].size();
+		return a<b;
+	}
+
+	const std::vector<std::vector<uint32_t> > &buckets;
+};
+
+
+/*
+ * Hash and displace: keys are distributed over one bucket per key. Buckets
+ * are then placed largest first by searching for a displacement value
+ * which moves all their keys to free slots. Buckets with a single key are
+ * placed last, directly in one of the remaining free slots.
+ */
+void FrozenConfig::BuildTable(const std::vector<std::pair<const char*, size_t> > &keys,
+		std::vector<uint32_t> &table, std::vector<uint32_t> &slots) {
+	const uint32_t n = keys.size();
+	std::vector<uint64_t> hashes(n);
+	std::vector<std::vector<uint32_t> > buckets;
+	std::vector<uint32_t> order;
+	std::vector<bool> used;
+	std::vector<uint32_t> trial;
+
+	table.assign(n+1, 0);
+	slots.assign(n, 0);
+	if (!n) {
+		table[0]=1;
+		return;
+	}
+
+	for (uint32_t seed=1; ; seed++) {
+		bool ok = true;
+
+		table.assign(n+1, 0);
+		table[0]=seed;
+		buckets.assign(n, std::vector<uint32_t>());
+		for (uint32_t i=0; i<n; i++) {
+			hashes[i]=Hash(keys[i].first, keys[i].second, seed);
+			buckets[static_cast<uint32_t>(hashes[i])%n].push_back(i);
+		}
+
+		order.resize(n);
+		for (uint32_t i=0; i<n; i++)
+			order[i]=i;
+		std::sort(order.begin(), order.end(), BucketSizeGreater(buckets));
+
+		used.assign(n, false);
+		uint32_t b = 0;
+		for (; b<n && ok && buckets[order[b]].size()>1; b++) {
+			const std::vector<uint32_t> &bucket = buckets[order[b]];
+			uint32_t d;
+
+			for (d=1; d<(1u<<20); d++) {
+				table[1+order[b]]=d;
+				trial.clear();
+				for (std::vector<uint32_t>::const_iterator k=bucket.begin(); k!=bucket.end(); k++) {
+					uint32_t slot = Slot(&table[0], n, hashes[*k]);
+					if (used[slot] || std::find(trial.begin(), trial.end(), slot)!=trial.end())
+						break;
+					trial.push_back(slot);
+				}
+				if (trial.size()==bucket.size())
+					break;
+			}
+
+			if (d==(1u<<20)) {
+				ok=false;
+				break;
+			}
+
+			for (uint32_t k=0; k<bucket.size(); k++) {
+				used[trial[k]]=true;
+				slots[bucket[k]]=trial[k];
+			}
+		}
+
+		if (!ok) {
+			// duplicate keys would make every seed fail
+			if (seed>64)
+				throw std::logic_error("can not build perfect hash table; duplicate keys?");
+			continue;
+		}
+
+		uint32_t freeslot = 0;
+		for (; b<n && buckets[order[b]].size()==1; b++) {
+			while (used[freeslot])
+				freeslot++;
+			used[freeslot]=true;
+			table[1+order[b]]=0x80000000 | freeslot;
+			slots[buckets[order[b]][0]]=freeslot;
+		}
+		return;
+	}
+}
+
+
+/* Helper which collects nodes, hash tables and strings and lays them out
+ * as an image. */
+class FrozenBuilder {
+public:
+	/** Add a NUL-terminated string to the string area and return its
+	 * offset within that area. */
+	uint64_t AddString(const char *data, size_t length) {
+		uint64_t offset = strings.size();
+		strings.append(data, length);
+		strings+='\0';
+		return offset;
+	}
+
+	/** Add a hash table and return its index. */
+	uint32_t AddTable(const std::vector<uint32_t> &table) {
+		uint32_t index = tables.size();
+		tables.insert(tables.end(), table.begin(), table.end());
+		return index;
+	}
+
+	/** Copy everything into the image of \a fc. */
+	void Finish(FrozenConfig &fc);
+
+	std::vector<FrozenNode>	nodes;
+	std::vector<uint32_t>	tables;
+	std::string		strings;
+};
+
+
+static inline uint64_t align8(uint64_t offset) {
+	return (offset+7) & ~static_cast<uint64_t>(7);
+}
+
+
+void FrozenBuilder::Finish(FrozenConfig &fc) {
+	FrozenHeader hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic=FrozenConfig::Magic;
+	hdr.version=FrozenConfig::Version;
+	hdr.nodes=align8(sizeof(hdr));
+	hdr.nodecount=nodes.size();
+	hdr.tables=align8(hdr.nodes + nodes.size()*sizeof(FrozenNode));
+	hdr.tablecount=tables.size();
+	hdr.strings=align8(hdr.tables + tables.size()*sizeof(uint32_t));
+	hdr.stringsize=strings.size();
+	hdr.size=align8(hdr.strings + strings.size());
+
+	// string references become image offsets
+	for (std::vector<FrozenNode>::iterator i=nodes.begin(); i!=nodes.end(); i++) {
+		i->key+=hdr.strings;
+		if (i->type==ConfigData::String)
+			i->value+=hdr.strings;
+	}
+
+	fc.storage.assign(hdr.size/8, 0);
+	char *image = reinterpret_cast<char*>(&fc.storage[0]);
+
+	memcpy(image, &hdr, sizeof(hdr));
+	if (!nodes.empty())
+		memcpy(image+hdr.nodes, &nodes[0], nodes.size()*sizeof(FrozenNode));
+	if (!tables.empty())
+		memcpy(image+hdr.tables, &tables[0], tables.size()*sizeof(uint32_t));
+	memcpy(image+hdr.strings, strings.data(), strings.size());
+
+	fc.image=image;
+	fc.imagesize=hdr.size;
+}
+
+
+FrozenConfig::FrozenConfig(const ConfigData &cfg) : image(0), imagesize(0) {
+	FrozenBuilder builder;
+	std::vector<std::pair<const ConfigData*, uint32_t> > queue;
+	std::vector<std::pair<const char*, size_t> > keys;
+	std::vector<uint32_t> table, slots;
+	FrozenNode blank;
+
+	memset(&blank, 0, sizeof(blank));
+	builder.nodes.push_back(blank);
+	queue.push_back(std::make_pair(&cfg, 0u));
+
+	// Breadth first, so the entries of every list and map are adjacent.
+	for (size_t head=0; head<queue.size(); head++) {
+		const ConfigData &node = *queue[head].first;
+		const uint32_t index = queue[head].second;
+		const uint32_t first = builder.nodes.size();
+
+		builder.nodes[index].type=node.type;
+
+		switch (node.type) {
+			case ConfigData::Integer:
+				builder.nodes[index].value=static_cast<uint64_t>(static_cast<int64_t>(node.intValue));
+				break;
+
+			case ConfigData::String:
+				builder.nodes[index].value=builder.AddString(node.strValue.data(), node.strValue.size());
+				builder.nodes[index].count=node.strValue.size();
+				break;
+
+			case ConfigData::List:
+				builder.nodes[index].value=first;
+				builder.nodes[index].count=node.ListSize();
+				builder.nodes.resize(first+node.ListSize(), blank);
+				if (node.packed) {
+					// packed entries are leaves, so they are filled in right away
+					const PackedList &list = *node.packed;
+
+					for (uint32_t i=0; i<list.size(); i++) {
+						FrozenNode &child = builder.nodes[first+i];
+
+						child.type=list.type;
+						if (list.type==ConfigData::Integer)
+							child.value=static_cast<uint64_t>(static_cast<int64_t>(list.integers[i]));
+						else {
+							size_t length;
+							const char *data = list.String(i, length);
+							child.value=builder.AddString(data, length);
+							child.count=length;
+						}
+					}
+				} else
+					for (uint32_t i=0; i<node.listValue.size(); i++)
+						queue.push_back(std::make_pair(node.listValue[i].get(), first+i));
+				break;
+
+			case ConfigData::Map:
+				{
+				keys.clear();
+				for (ConfigData::map_type::const_iterator i=node.mapValue.begin(); i!=node.mapValue.end(); i++)
+					keys.push_back(std::make_pair(i->first.data(), i->first.size()));
+				BuildTable(keys, table, slots);
+
+				builder.nodes[index].value=first;
+				builder.nodes[index].count=node.mapValue.size();
+				builder.nodes[index].table=builder.AddTable(table);
+				builder.nodes.resize(first+node.mapValue.size(), blank);
+
+				uint32_t j = 0;
+				for (ConfigData::map_type::const_iterator i=node.mapValue.begin(); i!=node.mapValue.end(); i++, j++) {
+					FrozenNode &child = builder.nodes[first+slots[j]];
+					child.key=builder.AddString(i->first.data(), i->first.size());
+					child.keylen=i->first.size();
+					queue.push_back(std::make_pair(i->second.get(), first+slots[j]));
+				}
+				break;
+				}
+
+			default:
+				break;
+		}
+	}
+
+	builder.Finish(*this);
+}
+
+
+FrozenConfig::FrozenConfig(const char *image, size_t size) : image(image), imagesize(size) {
+	Verify(image, size);
+	imagesize=header()->size;
+}
+
+
+FrozenConfig::FrozenConfig(std::vector<uint64_t> &storage) : image(0), imagesize(0) {
+	const char *data = reinterpret_cast<const char*>(storage.empty() ? 0 : &storage[0]);
+
+	Verify(data, storage.size()*sizeof(uint64_t));
+	this->storage.swap(storage);
+	image=reinterpret_cast<const char*>(&this->storage[0]);
+	imagesize=header()->size;
+}
+
+
+void FrozenConfig::Verify(const char *image, size_t size) {
+	const FrozenHeader *hdr = reinterpret_cast<const FrozenHeader*>(image);
+
+	if (reinterpret_cast<uintptr_t>(image)%8)
+		throw std::runtime_error("frozen configuration image is not aligned");
+	if (size<sizeof(FrozenHeader) || hdr->magic!=Magic)
+		throw std::runtime_error("not a frozen configuration image");
+	if (hdr->version!=Version)
+		throw std::runtime_error("unsupported frozen configuration version");
+	if (hdr->size>size || hdr->nodecount==0 ||
+			hdr->nodes%8 || hdr->tables%4 ||
+			hdr->nodes+hdr->nodecount*sizeof(FrozenNode)>hdr->size ||
+			hdr->tables+hdr->tablecount*sizeof(uint32_t)>hdr->size ||
+			hdr->strings+hdr->stringsize>hdr->size)
+		throw std::runtime_error("corrupt frozen configuration image");
+
+	const FrozenNode *nodes = reinterpret_cast<const FrozenNode*>(image+hdr->nodes);
+	const uint64_t strend = hdr->strings+hdr->stringsize;
+
+	for (uint64_t i=0; i<hdr->nodecount; i++) {
+		const FrozenNode &n = nodes[i];
+		bool ok = true;
+
+		if (n.keylen && (n.key<hdr->strings || n.key+n.keylen>=strend))
+			ok=false;
+
+		switch (n.type) {
+			case ConfigData::Bogus:
+			case ConfigData::Integer:
+				break;
+
+			case ConfigData::String:
+				ok=ok && n.value>=hdr->strings && n.value+n.count<strend && image[n.value+n.count]==0;
+				break;
+
+			case ConfigData::Map:
+				ok=ok && static_cast<uint64_t>(n.table)+1+n.count<=hdr->tablecount;
+				// fall through
+
+			case ConfigData::List:
+				ok=ok && n.value>i && n.value+n.count<=hdr->nodecount;
+				break;
+
+			default:
+				ok=false;
+		}
+
+		if (!ok)
+			throw std::runtime_error("corrupt frozen configuration image");
+	}
+}
+
+
+boost::shared_ptr<FrozenConfig> Freeze(const ConfigData &cfg) {
+	return boost::shared_ptr<FrozenConfig>(new FrozenConfig(cfg));
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_frozen_included__
+#define __wta_frozen_included__
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "configdata.hh"
+
+
+/** Node in a frozen configuration image.
+ * All references are offsets or indices, so an image can be copied,
+ * written to disk or mapped at any address.
+ */
+struct FrozenNode {
+	uint64_t	key;	/*!< offset of the key in the string area (map entries only) */
+	uint64_t	value;	/*!< integer value, string offset, or index of the first child */
+	uint32_t	keylen;	/*!< length of the key */
+	uint32_t	count;	/*!< string length, or number of children */
+	uint32_t	table;	/*!< index of the hash table (maps only) */
+	uint8_t		type;	/*!< ConfigData::data_type of this node */
+	uint8_t		pad[3];
+};
+
+
+/** Header of a frozen configuration image. */
+struct FrozenHeader {
+	uint32_t	magic;		/*!< FrozenConfig::Magic */
+	uint32_t	version;	/*!< FrozenConfig::Version */
+	uint64_t	size;		/*!< total image size in bytes */
+	uint64_t	nodes;		/*!< offset of the node array */
+	uint64_t	nodecount;	/*!< number of nodes; the root is node 0 */
+	uint64_t	tables;		/*!< offset of the hash table area */
+	uint64_t	tablecount;	/*!< number of 32 bit words in the hash table area */
+	uint64_t	strings;	/*!< offset of the string area */
+	uint64_t	stringsize;	/*!< size of the string area */
+};
+
+
+class FrozenConfig;
+
+
+/** Read-only view of an entry in a FrozenConfig.
+ *
+ * FrozenData offers the same access operators as ConfigData. It is a
+ * small value type which simply points into the image, so copying it is
+ * cheap and no reference counting is involved.
+ */
+class FrozenData {
+public:
+	FrozenData(const char *base, const FrozenNode *node) : base(base), node(node) { }
+
+	/** Return the type of this entry. */
+	ConfigData::data_type type() const {
+		return static_cast<ConfigData::data_type>(node->type);
+	}
+
+	/** Return the number of entries in a list or map. */
+	size_t size() const {
+		return (node->type==ConfigData::List || node->type==ConfigData::Map) ? node->count : 0;
+	}
+
+	/** Return the key under which this entry is stored in its map. */
+	std::string key() const {
+		return std::string(base+node->key, node->keylen);
+	}
+
+	/** Return a child by position.
+	 * Lists store their entries in order. Maps store their entries in
+	 * hash order, which is stable for a given image but otherwise
+	 * arbitrary.
+	 */
+	FrozenData child(size_t index) const {
+		if (index>=size())
+			throw std::range_error("Index out of range");
+		return FrozenData(base, nodes()+node->value+index);
+	}
+
+	/** Integer cast operator.
+	 * \return integer value stored in this entry
+	 */
+	operator int() const {
+		if (node->type!=ConfigData::Integer)
+			throw type_error("integer-style access on non-integer data");
+		return static_cast<int>(static_cast<int64_t>(node->value));
+	}
+
+	/** String cast operator.
+	 * \return pointer to the NUL-terminated string in the image
+	 */
+	operator const char*() const {
+		if (node->type!=ConfigData::String)
+			throw type_error("string-style access on non-string data");
+		return base+node->value;
+	}
+
+	/** String cast operator.
+	 * \return copy of the string value
+	 */
+	operator std::string() const {
+		if (node->type!=ConfigData::String)
+			throw type_error("string-style access on non-string data");
+		return std::string(base+node->value, node->count);
+	}
+
+	/** Array access operator.
+	 * \return entry in the list
+	 */
+	FrozenData operator[](int index) const {
+		if (node->type!=ConfigData::List)
+			throw type_error("list-style access on non-list data");
+		if (index<0 || static_cast<uint32_t>(index)>=node->count)
+			throw std::range_error("Index out of range");
+		return FrozenData(base, nodes()+node->value+index);
+	}
+
+	/** Map access operator.
+	 * \return entry in the subsection
+	 */
+	FrozenData operator[](const char *index) const {
+		return Get(index, strlen(index));
+	}
+
+	/** Map access operator.
+	 * \return entry in the subsection
+	 */
+	FrozenData operator[](const std::string &index) const {
+		return Get(index.data(), index.size());
+	}
+
+	/** Check if a map contains a key. */
+	bool Contains(const std::string &index) const {
+		return node->type==ConfigData::Map && Find(index.data(), index.size());
+	}
+
+protected:
+	/** Look up a key, throwing if it does not exist. */
+	FrozenData Get(const char *key, size_t length) const {
+		if (node->type!=ConfigData::Map)
+			throw type_error("map-style access on non-map data");
+		const FrozenNode *n = Find(key, length);
+		if (!n)
+			throw std::range_error("Key not found");
+		return FrozenData(base, n);
+	}
+
+	/** Look up a key using the perfect hash table of this map. */
+	const FrozenNode *Find(const char *key, size_t length) const;
+
+	/** Return the node array of the image. */
+	const FrozenNode *nodes() const {
+		return reinterpret_cast<const FrozenNode*>(base+reinterpret_cast<const FrozenHeader*>(base)->nodes);
+	}
+
+	const char		*base;	/*!< start of the image */
+	const FrozenNode	*node;	/*!< node this view refers to */
+};
+
+
+/** Frozen configuration.
+ *
+ * A compact, immutable copy of a ConfigData tree for configurations which
+ * are read much more often than they change. The whole tree lives in a
+ * single block of memory: all nodes in one array with the entries of every
+ * list or map stored next to each other, and all strings in one string
+ * area. Each map has a minimal perfect hash table over its keys, so a
+ * lookup costs one hash and one key comparison per level. Small maps are
+ * searched linearly instead.
+ *
+ * The image contains no pointers. It can be used where it was built, or
+ * taken from elsewhere (a file or shared memory) with the image
+ * constructor.
+ */
+class FrozenConfig : public boost::noncopyable {
+public:
+	enum {
+		Magic = 0x46434953,	/*!< "SICF" */
+		Version = 1,
+		ScanLimit = 4	/*!< maps up to this size are searched linearly */
+	};
+
+	/** Freeze a configuration tree.
+	 * \param cfg tree to freeze
+	 */
+	explicit FrozenConfig(const ConfigData &cfg);
+
+	/** Use an existing image.
+	 * The image is checked for consistency but not copied; it must stay
+	 * valid for the lifetime of this instance.
+	 *
+	 * \param image start of the image. Must be 8-byte aligned.
+	 * \param size size of the image in bytes
+	 */
+	FrozenConfig(const char *image, size_t size);
+
+	/** Take over an image.
+	 * The image is checked for consistency and moved into this
+	 * instance; \a image is left empty.
+	 *
+	 * \param image storage holding the image
+	 */
+	explicit FrozenConfig(std::vector<uint64_t> &image);
+
+	/** Return the root of the configuration. */
+	FrozenData root() const {
+		return FrozenData(image, reinterpret_cast<const FrozenNode*>(image+header()->nodes));
+	}
+
+	/** Map access operator on the root. */
+	FrozenData operator[](const char *index) const { return root()[index]; }
+
+	/** Map access operator on the root. */
+	FrozenData operator[](const std::string &index) const { return root()[index]; }
+
+	/** Return the image. */
+	const char *data() const { return image; }
+
+	/** Return the image size in bytes. */
+	size_t size() const { return imagesize; }
+
+	/** Hash function used for map keys. */
+	static uint64_t Hash(const char *data, size_t length, uint64_t seed);
+
+	/** Compute the slot of a key hash in a map's hash table.
+	 * \param table hash table: seed followed by one displacement per bucket
+	 * \param count number of entries in the map
+	 * \param hash hash of the key
+	 */
+	static uint32_t Slot(const uint32_t *table, uint32_t count, uint64_t hash) {
+		uint32_t d = table[1 + static_cast<uint32_t>(hash)%count];
+
+		if (d & 0x80000000)
+			return d & 0x7fffffff;
+		uint32_t x = static_cast<uint32_t>(hash>>32) ^ (d*0x9e3779b9u);
+		x^=x>>16;
+		x*=0x85ebca6bu;
+		x^=x>>13;
+		x*=0xc2b2ae35u;
+		x^=x>>16;
+		return x%count;
+	}
+
+	/** Build a minimal perfect hash table.
+	 * \param keys keys of the map, which must be unique
+	 * \param table receives the hash table: seed followed by one
+	 * 	displacement per key
+	 * \param slots receives the slot of every key
+	 */
+	static void BuildTable(const std::vector<std::pair<const char*, size_t> > &keys,
+			std::vector<uint32_t> &table, std::vector<uint32_t> &slots);
+
+	/** Verify an image.
+	 * Throws std::runtime_error if the image is not a valid frozen
+	 * configuration.
+	 */
+	static void Verify(const char *image, size_t size);
+
+protected:
+	const FrozenHeader *header() const {
+		return reinterpret_cast<const FrozenHeader*>(image);
+	}
+
+	std::vector<uint64_t>	storage;	/*!< image storage when built here */
+	const char		*image;		/*!< the image */
+	size_t			imagesize;	/*!< size of the image */
+
+	friend class FrozenBuilder;
+};
+
+
+/** Freeze a configuration tree.
+ * \param cfg tree to freeze
+ * \return frozen copy of the tree
+ */
+boost::shared_ptr<FrozenConfig> Freeze(const ConfigData &cfg);
+
+
+inline const FrozenNode *FrozenData::Find(const char *key, size_t length) const {
+	const FrozenHeader *hdr = reinterpret_cast<const FrozenHeader*>(base);
+	const uint32_t *table = reinterpret_cast<const uint32_t*>(base+hdr->tables) + node->table;
+
+	const FrozenNode *n = nodes() + node->value;
+
+	// for small maps comparing the keys is cheaper than hashing
+	if (node->count<=FrozenConfig::ScanLimit) {
+		for (const FrozenNode *end=n+node->count; n!=end; n++)
+			if (n->keylen==length && !memcmp(base+n->key, key, length))
+				return n;
+		return 0;
+	}
+
+	n+=FrozenConfig::Slot(table, node->count, FrozenConfig::Hash(key, length, table[0]));
+	if (n->keylen!=length || memcmp(base+n->key, key, length))
+		return 0;
+	return n;
+}
+
+#endif
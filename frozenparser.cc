@@ -0,0 +1,472 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <vector>
+#include "frozenparser.hh"
+#include "tokenize.hh"
+#include "iscparser.hh"
+#include "file.hh"
+
+
+/* ISC grammar shared by both passes. In the counting pass only the
+ * number of entries per section and the string sizes are recorded; in
+ * the building pass the image is filled in. */
+class FrozenParser : public TokenHandler {
+public:
+	FrozenParser() : counting(true), state(InMap), pendingKey(0), pendingLength(0) {
+		Section root;
+
+		memset(&root, 0, sizeof(root));
+		root.map=true;
+		open.push_back(root);
+		counts.push_back(0);
+		maps.push_back(true);
+		strings=0;
+	}
+
+	/** Switch from counting to building.
+	 * \param image receives the (empty) image
+	 */
+	void Prepare(std::vector<uint64_t> &image);
+
+	/** Whitespace and comments carry no meaning, so skip them. */
+	virtual unsigned int TokenMask() const {
+		return AllTokens & ~(WhitespaceToken|CommentToken);
+	}
+
+	virtual void HandleString(const char *data, size_t length);
+	virtual void HandleInteger(const char *data, size_t length);
+	virtual void HandleKeyword(const char *data, size_t length);
+	virtual void HandleCharacter(const char *data, size_t length);
+	virtual void HandleWhitespace(const char *, size_t) { }
+	virtual void HandleEndOfInput();
+
+protected:
+	/** Possible state machine states; see ISCParser. */
+	enum state_type {
+		InSection,
+		InMap,
+		InMapKeyword,
+		InMapNeedTerminator,
+		InList,
+		InListNeedTerminator,
+		EndingSection
+	};
+
+	/** An open section. */
+	struct Section {
+		uint32_t	serial;	/*!< number of the section in input order */
+		uint32_t	entry;	/*!< node of the section itself */
+		uint32_t	first;	/*!< first node of the block of entries */
+		uint32_t	next;	/*!< next free node in the block */
+		bool		map;	/*!< map or list */
+	};
+
+	/** Add an entry to the current section.
+	 * \return index of the new node, when building
+	 */
+	uint32_t AddEntry(uint8_t type, const char *value, size_t length);
+
+	/** Add a scalar value to the current section. */
+	void AddValue(uint8_t type, uint64_t value, const char *data, size_t length);
+
+	/** Open a section for the pending key. */
+	void OpenSection(bool map);
+
+	/** Close the current section. */
+	void CloseSection();
+
+	/** Copy a string into the string area. */
+	uint64_t AddString(const char *data, size_t length);
+
+	bool			counting;	/*!< first pass */
+	state_type		state;
+	const char		*pendingKey;	/*!< last key, pointing into the input */
+	size_t			pendingLength;	/*!< length of the last key */
+	std::vector<Section>	open;		/*!< open sections, the root first */
+
+	// filled in by the counting pass
+	std::vector<uint32_t>	counts;		/*!< entries per section, in input order */
+	std::vector<bool>	maps;		/*!< section is a map, in input order */
+	uint64_t		strings;	/*!< bytes needed for keys and strings */
+
+	// used by the building pass
+	uint32_t		serial;		/*!< next section number */
+	char			*base;		/*!< the image */
+	FrozenNode		*nodes;		/*!< node array in the image */
+	uint32_t		nodecount;	/*!< nodes allocated so far */
+	uint32_t		*tables;	/*!< hash table area in the image */
+	uint32_t		tablecount;	/*!< hash table words allocated so far */
+	uint64_t		stringpos;	/*!< next free byte of the string area */
+
+	// scratch space for closing maps
+	std::vector<uint32_t>				order;
+	std::vector<std::pair<const char*, size_t> >	keys;
+	std::vector<uint32_t>				table, slots;
+	std::vector<FrozenNode>				block;
+};
+
+
+static inline uint64_t align8(uint64_t offset) {
+	return (offset+7) & ~static_cast<uint64_t>(7);
+}
+
+
+void FrozenParser::Prepare(std::vector<uint64_t> &image) {
+	uint64_t nodetotal = 1, tabletotal = 0;
+	FrozenHeader hdr;
+
+	for (size_t i=0; i<counts.size(); i++) {
+		nodetotal+=counts[i];
+		if (maps[i])
+			tabletotal+=counts[i]+1;
+	}
+	if (nodetotal>UINT_MAX || tabletotal>UINT_MAX)
+		throw parse_error("configuration too large");
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic=FrozenConfig::Magic;
+	hdr.version=FrozenConfig::Version;
+	hdr.nodes=align8(sizeof(hdr));
+	hdr.nodecount=nodetotal;
+	hdr.tables=align8(hdr.nodes + nodetotal*sizeof(FrozenNode));
+	hdr.tablecount=tabletotal;
+	hdr.strings=align8(hdr.tables + tabletotal*sizeof(uint32_t));
+	hdr.stringsize=strings;
+	hdr.size=align8(hdr.strings + strings);
+
+	image.assign(hdr.size/8, 0);
+	base=reinterpret_cast<char*>(&image[0]);
+	memcpy(base, &hdr, sizeof(hdr));
+	nodes=reinterpret_cast<FrozenNode*>(base+hdr.nodes);
+	tables=reinterpret_cast<uint32_t*>(base+hdr.tables);
+	stringpos=hdr.strings;
+
+	// the root and its block
+	nodes[0].type=ConfigData::Map;
+	nodes[0].value=1;
+	nodes[0].table=0;
+	nodecount=1+counts[0];
+	tablecount=counts[0]+1;
+	serial=1;
+
+	open.clear();
+	Section root;
+	root.serial=0;
+	root.entry=0;
+	root.first=root.next=1;
+	root.map=true;
+	open.push_back(root);
+
+	counting=false;
+	state=InMap;
+}
+
+
+uint64_t FrozenParser::AddString(const char *data, size_t length) {
+	uint64_t offset = stringpos;
+
+	memcpy(base+stringpos, data, length);
+	base[stringpos+length]=0;
+	stringpos+=length+1;
+	return offset;
+}
+
+
+uint32_t FrozenParser::AddEntry(uint8_t type, const char *key, size_t keylength) {
+	Section &section = open.back();
+
+	if (counting) {
+		counts[section.serial]++;
+		if (key)
+			strings+=keylength+1;
+		return 0;
+	}
+
+	const uint32_t index = section.next++;
+	FrozenNode &node = nodes[index];
+
+	node.type=type;
+	if (key) {
+		node.key=AddString(key, keylength);
+		node.keylen=keylength;
+	}
+	return index;
+}
+
+
+void FrozenParser::AddValue(uint8_t type, uint64_t value, const char *data, size_t length) {
+	const bool map = open.back().map;
+	const uint32_t index = AddEntry(type, map ? pendingKey : 0, pendingLength);
+
+	if (counting) {
+		if (type==ConfigData::String)
+			strings+=length+1;
+		return;
+	}
+
+	if (type==ConfigData::String) {
+		nodes[index].value=AddString(data, length);
+		nodes[index].count=length;
+	} else
+		nodes[index].value=value;
+}
+
+
+void FrozenParser::OpenSection(bool map) {
+	const uint32_t entry = AddEntry(map ? ConfigData::Map : ConfigData::List, pendingKey, pendingLength);
+	Section section;
+
+	section.map=map;
+	if (counting) {
+		section.serial=counts.size();
+		counts.push_back(0);
+		maps.push_back(map);
+		open.push_back(section);
+		return;
+	}
+
+	section.serial=serial++;
+	section.entry=entry;
+	section.first=section.next=nodecount;
+	nodecount+=counts[section.serial];
+
+	nodes[entry].value=section.first;
+	if (map) {
+		nodes[entry].table=tablecount;
+		tablecount+=counts[section.serial]+1;
+	}
+	open.push_back(section);
+}
+
+
+struct KeyOrder {
+	KeyOrder(const char *base, const FrozenNode *nodes) : base(base), nodes(nodes) { }
+
+	bool operator()(uint32_t a, uint32_t b) const {
+		const FrozenNode &x = nodes[a], &y = nodes[b];
+		int r = memcmp(base+x.key, base+y.key, std::min(x.keylen, y.keylen));
+
+		if (r)
+			return r<0;
+		if (x.keylen!=y.keylen)
+			return x.keylen<y.keylen;
+		return a<b;
+	}
+
+	const char		*base;
+	const FrozenNode	*nodes;
+};
+
+
+void FrozenParser::CloseSection() {
+	const Section section = open.back();
+
+	open.pop_back();
+	if (counting)
+		return;
+
+	const uint32_t count = section.next-section.first;
+
+	if (!section.map) {
+		nodes[section.entry].count=count;
+		return;
+	}
+
+	// Keep the last value of every key.
+	order.clear();
+	for (uint32_t i=section.first; i<section.next; i++)
+		order.push_back(i);
+	std::sort(order.begin(), order.end(), KeyOrder(base, nodes));
+
+	keys.clear();
+	block.clear();
+	for (size_t i=0; i<order.size(); i++) {
+		const FrozenNode &node = nodes[order[i]];
+
+		if (i+1<order.size()) {
+			const FrozenNode &next = nodes[order[i+1]];
+			if (next.keylen==node.keylen && !memcmp(base+node.key, base+next.key, node.keylen))
+				continue;
+		}
+		keys.push_back(std::make_pair(base+node.key, static_cast<size_t>(node.keylen)));
+		block.push_back(node);
+	}
+
+	FrozenConfig::BuildTable(keys, table, slots);
+	std::copy(table.begin(), table.end(), tables+nodes[section.entry].table);
+
+	// Move the entries to their slots.
+	memset(nodes+section.first, 0, count*sizeof(FrozenNode));
+	for (size_t i=0; i<block.size(); i++)
+		nodes[section.first+slots[i]]=block[i];
+
+	nodes[section.entry].count=block.size();
+}
+
+
+void FrozenParser::HandleKeyword(const char *data, size_t length) {
+	switch (state) {
+		case InSection:
+			OpenSection(true);
+			// fall through - no break here on purpose!
+
+		case InMap:
+			pendingKey=data;
+			pendingLength=length;
+			state=InMapKeyword;
+			break;
+
+		default:
+			throw parse_error("keyword not allowed in this context");
+	}
+}
+
+
+void FrozenParser::HandleString(const char *data, size_t length) {
+	switch (state) {
+		case InMapKeyword:
+			AddValue(ConfigData::String, 0, data, length);
+			state=InMapNeedTerminator;
+			break;
+
+		case InSection:
+			OpenSection(false);
+			// fall through - no break here on purpose!
+
+		case InList:
+			AddValue(ConfigData::String, 0, data, length);
+			state=InListNeedTerminator;
+			break;
+
+		default:
+			throw parse_error("string not allowed in this context");
+	}
+}
+
+
+void FrozenParser::HandleInteger(const char *data, size_t length) {
+	long int value;
+
+	if (!ParsedTokenHandler::ParseInteger(data, length, value))
+		throw parse_error("integer out of range");
+
+	// stored the way ConfigData stores it
+	const uint64_t stored = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int>(value)));
+
+	switch (state) {
+		case InMapKeyword:
+			AddValue(ConfigData::Integer, stored, 0, 0);
+			state=InMapNeedTerminator;
+			break;
+
+		case InSection:
+			OpenSection(false);
+			// fall through - no break here on purpose!
+
+		case InList:
+			AddValue(ConfigData::Integer, stored, 0, 0);
+			state=InListNeedTerminator;
+			break;
+
+		default:
+			throw parse_error("integer not allowed in this context");
+	}
+}
+
+
+void FrozenParser::HandleCharacter(const char *data, size_t) {
+	switch (*data) {
+		case '{':
+			if (state!=InMapKeyword)
+				throw parse_error("Unexpected { found");
+			state=InSection;
+			break;
+
+		case '}':
+			switch (state) {
+				case InSection:
+					OpenSection(true);
+					CloseSection();
+					break;
+
+				case InMap:
+				case InList:
+					if (open.size()<=1)
+						throw parse_error("Can not close the root section");
+					CloseSection();
+					break;
+
+				default:
+					throw parse_error("Unexpected } found");
+			}
+			state=EndingSection;
+			break;
+
+		case ';':
+			switch (state) {
+				case InMapNeedTerminator:
+				case EndingSection:
+					state=InMap;
+					break;
+
+				case InListNeedTerminator:
+					state=InList;
+					break;
+
+				default:
+					throw parse_error("Unexpected seperator (;) found");
+			}
+			break;
+
+		default:
+			throw parse_error("Unexpected character found");
+	}
+}
+
+
+void FrozenParser::HandleEndOfInput() {
+	if (state!=InMap || open.size()!=1)
+		throw parse_error("Unexpected end of input");
+
+	CloseSection();
+}
+
+
+boost::shared_ptr<FrozenConfig> ParseFrozen(const char *data, size_t length) {
+	FrozenParser parser;
+	std::vector<uint64_t> image;
+
+	for (int pass=0; pass<2; pass++) {
+		Tokenizer toker(data, length);
+
+		if (pass)
+			parser.Prepare(image);
+		try {
+			toker.Tokenize(parser);
+		} catch (parse_error &e) {
+			e.Locate(data, length, toker.offset());
+			throw;
+		}
+	}
+
+	return boost::shared_ptr<FrozenConfig>(new FrozenConfig(image));
+}
+
+
+boost::shared_ptr<FrozenConfig> ReadFrozen(const char *fn) {
+	MemoryFile input(fn);
+
+	try {
+		return ParseFrozen(input.data, input.size);
+	} catch (parse_error &e) {
+		e.SetFile(fn);
+		throw;
+	}
+}
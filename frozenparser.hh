@@ -0,0 +1,43 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_frozenparser_included__
+#define __wta_frozenparser_included__
+
+#include <boost/shared_ptr.hpp>
+#include "frozen.hh"
+
+/** Parse an ISC configuration straight into a FrozenConfig.
+ *
+ * This reads the input twice. The first pass only counts the entries of
+ * every section and the bytes of all keys and strings. The second pass
+ * writes nodes, hash tables and strings straight into an image of exactly
+ * that size: no ConfigData tree is built, nothing is reallocated and no
+ * token is copied to a temporary string.
+ *
+ * The result is the same as freezing the tree ISCParser would build,
+ * except for the order of entries in the image. If a map contains a key
+ * more than once the last value wins, as with ISCParser; the space for
+ * the earlier values stays unused in the image.
+ *
+ * Parse errors are reported with a parse_error exception which includes
+ * the line and column.
+ *
+ * \param data configuration text
+ * \param length size of the configuration text
+ * \return the frozen configuration
+ */
+boost::shared_ptr<FrozenConfig> ParseFrozen(const char *data, size_t length);
+
+/** Read an ISC configuration file straight into a FrozenConfig.
+ * \sa ParseFrozen
+ *
+ * \param fn path of file to read
+ * \return the frozen configuration
+ */
+boost::shared_ptr<FrozenConfig> ReadFrozen(const char *fn);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "interner.hh"
+
+
+static inline uint64_t mix(uint64_t h, uint64_t v) {
+	h^=v + 0x9e3779b97f4a7c15ULL + (h<<6) + (h>>2);
+	h*=0xbf58476d1ce4e5b9ULL;
+	return h ^ (h>>31);
+}
+
+
+static inline uint64_t hashstring(uint64_t h, const std::string &str) {
+	const char *p = str.data();
+	size_t length = str.size();
+
+	h=mix(h, length);
+	for (; length>=8; p+=8, length-=8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		h=mix(h, v);
+	}
+	if (length) {
+		uint64_t v = 0;
+		memcpy(&v, p, length);
+		h=mix(h, v);
+	}
+	return h;
+}
+
+
+uint64_t Interner::Hash(const ConfigData &node) {
+	uint64_t h = mix(0, node.type);
+
+	switch (node.type) {
+		case ConfigData::Integer:
+			return mix(h, static_cast<uint64_t>(node.intValue));
+
+		case ConfigData::String:
+			return hashstring(h, node.strValue);
+
+		case ConfigData::List:
+			if (node.packed) {
+				const PackedList &list = *node.packed;
+
+				h=mix(h, list.type);
+				if (list.type==ConfigData::Integer) {
+					for (std::vector<int>::const_iterator i=list.integers.begin(); i!=list.integers.end(); i++)
+						h=mix(h, static_cast<uint64_t>(*i));
+					return h;
+				}
+				// strings may contain NUL, so the blob alone is ambiguous
+				for (std::vector<size_t>::const_iterator i=list.ends.begin(); i!=list.ends.end(); i++)
+					h=mix(h, *i);
+				return hashstring(h, list.strings);
+			}
+			for (ConfigData::list_type::const_iterator i=node.listValue.begin(); i!=node.listValue.end(); i++)
+				h=mix(h, reinterpret_cast<uintptr_t>(i->get()));
+			return h;
+
+		case ConfigData::Map:
+			for (ConfigData::map_type::const_iterator i=node.mapValue.begin(); i!=node.mapValue.end(); i++)
+				h=mix(hashstring(h, i->first), reinterpret_cast<uintptr_t>(i->second.get()));
+			return h;
+
+		default:
+			return h;
+	}
+}
+
+
+bool Interner::Same(const ConfigData &a, const ConfigData &b) {
+	if (a.type!=b.type)
+		return false;
+
+	switch (a.type) {
+		case ConfigData::Integer:
+			return a.intValue==b.intValue;
+
+		case ConfigData::String:
+			return a.strValue==b.strValue;
+
+		case ConfigData::List:
+			if (a.packed || b.packed) {
+				if (!a.packed || !b.packed)
+					return false;
+				if (a.packed==b.packed)
+					return true;
+				return a.packed->type==b.packed->type && a.packed->integers==b.packed->integers &&
+					a.packed->ends==b.packed->ends && a.packed->strings==b.packed->strings;
+			}
+			// children are interned, so comparing pointers is enough
+			return a.listValue==b.listValue;
+
+		case ConfigData::Map:
+			if (a.mapValue.size()!=b.mapValue.size())
+				return false;
+			for (ConfigData::map_type::const_iterator i=a.mapValue.begin(), j=b.mapValue.begin(); i!=a.mapValue.end(); i++, j++)
+				if (i->second!=j->second || i->first!=j->first)
+					return false;
+			return true;
+
+		default:
+			return true;
+	}
+}
+
+
+boost::shared_ptr<ConfigData> Interner::Canonical(const boost::shared_ptr<ConfigData> &node) {
+	const uint64_t hash = Hash(*node);
+	std::pair<table_type::iterator, table_type::iterator> range = table.equal_range(hash);
+
+	for (table_type::iterator i=range.first; i!=range.second; i++) {
+		boost::shared_ptr<ConfigData> candidate = i->second.lock();
+
+		if (candidate && (candidate==node || Same(*candidate, *node))) {
+			if (candidate!=node)
+				hits++;
+			return candidate;
+		}
+	}
+
+	if (table.size()>=purgeAt) {
+		Purge();
+		purgeAt=std::max(table.size()*2, static_cast<size_t>(1024));
+	}
+
+	table.insert(std::make_pair(hash, boost::weak_ptr<ConfigData>(node)));
+	misses++;
+	return node;
+}
+
+
+/* A node being interned: its children are handled first. */
+struct InternFrame {
+	explicit InternFrame(boost::shared_ptr<ConfigData> *slot) :
+		slot(slot), index(0), entry((*slot)->mapValue.begin()) { }
+
+	boost::shared_ptr<ConfigData>		*slot;	/*!< where the node is referenced from */
+	size_t					index;	/*!< next list entry */
+	ConfigData::map_type::iterator		entry;	/*!< next map entry */
+};
+
+
+boost::shared_ptr<ConfigData> Interner::Intern(const boost::shared_ptr<ConfigData> &cfg) {
+	boost::shared_ptr<ConfigData> root = cfg;
+	std::vector<InternFrame> stack;
+	// Subtrees shared within the tree are only processed once.
+	boost::unordered_map<const ConfigData*, boost::shared_ptr<ConfigData> > done;
+
+	if (!root)
+		return root;
+
+	stack.push_back(InternFrame(&root));
+	while (!stack.empty()) {
+		InternFrame &frame = stack.back();
+		ConfigData &node = **frame.slot;
+		boost::shared_ptr<ConfigData> *child = 0;
+
+		if (node.type==ConfigData::List && frame.index<node.listValue.size())
+			child=&node.listValue[frame.index++];
+		else if (node.type==ConfigData::Map && frame.entry!=node.mapValue.end())
+			child=&(frame.entry++)->second;
+
+		if (child) {
+			boost::unordered_map<const ConfigData*, boost::shared_ptr<ConfigData> >::const_iterator d = done.find(child->get());
+			if (d!=done.end()) {
+				if (*child!=d->second)
+					*child=d->second;
+			}
+			else if (*child)
+				stack.push_back(InternFrame(child));
+			continue;
+		}
+
+		// All children are interned. Slots are only written when they
+		// change, so already shared nodes are never modified.
+		boost::shared_ptr<ConfigData> canonical = Canonical(*frame.slot);
+		done[frame.slot->get()]=canonical;
+		if (canonical!=*frame.slot)
+			*frame.slot=canonical;
+		stack.pop_back();
+	}
+
+	return root;
+}
+
+
+boost::shared_ptr<ConfigData> Interner::Load(const char *fn, config_format format) {
+	return Intern(ReadConfig(fn, format));
+}
+
+
+void Interner::Purge() {
+	for (table_type::iterator i=table.begin(); i!=table.end(); )
+		if (i->second.expired())
+			i=table.erase(i);
+		else
+			i++;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_interner_included__
+#define __wta_interner_included__
+
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include "configdata.hh"
+#include "readconfig.hh"
+
+
+/** Subtree interner.
+ *
+ * Processes that hold many similar configurations, for example one per
+ * tenant, often keep many identical copies of the same sections. An
+ * Interner replaces identical subtrees with a single shared instance, so
+ * memory use grows with the amount of distinct content instead of with
+ * the number of configurations.
+ *
+ * Trees are processed bottom-up. Once the children of a node have been
+ * interned, two nodes are identical exactly when they have the same type,
+ * value and keys and point to the same children, so comparing nodes never
+ * needs to descend into the tree.
+ *
+ * The interner only keeps weak references: a subtree is released as soon
+ * as no configuration uses it any more.
+ *
+ * Interned nodes are shared between configurations and must be treated
+ * as read-only. In particular do not Merge into an interned tree.
+ *
+ * \code
+ * Interner interner;
+ * for (...)
+ *     tenants[name]=interner.Intern(ReadConfig(path));
+ * \endcode
+ */
+class Interner : public boost::noncopyable {
+public:
+	Interner() : hits(0), misses(0), purgeAt(1024) { }
+
+	/** Intern a tree.
+	 * The children of every map and list in the tree are replaced by
+	 * their shared instances.
+	 *
+	 * \param cfg root of the tree to intern
+	 * \return shared instance of the tree, which may be \a cfg itself
+	 */
+	boost::shared_ptr<ConfigData> Intern(const boost::shared_ptr<ConfigData> &cfg);
+
+	/** Read and intern a configuration file.
+	 * \sa ReadConfig
+	 */
+	boost::shared_ptr<ConfigData> Load(const char *fn, config_format format=AutoFormat);
+
+	/** Return the number of table entries.
+	 * This includes entries for subtrees which have been released but
+	 * not yet purged.
+	 */
+	size_t size() const { return table.size(); }
+
+	/** Remove entries for released subtrees from the table. */
+	void Purge();
+
+	unsigned long long	hits;	/*!< nodes replaced by an existing instance */
+	unsigned long long	misses;	/*!< nodes which became a new shared instance */
+
+protected:
+	/** Hash a node whose children have already been interned. */
+	static uint64_t Hash(const ConfigData &node);
+
+	/** Compare two nodes whose children have already been interned. */
+	static bool Same(const ConfigData &a, const ConfigData &b);
+
+	/** Return the shared instance of a node whose children have already
+	 * been interned. */
+	boost::shared_ptr<ConfigData> Canonical(const boost::shared_ptr<ConfigData> &node);
+
+	typedef boost::unordered_multimap<uint64_t, boost::weak_ptr<ConfigData> > table_type;
+
+	table_type	table;	/*!< shared instances by hash */
+	size_t		purgeAt;	/*!< table size at which to purge next */
+};
+
+#endif
@@ -4,12 +4,83 @@
  * See COPYING for license information.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include "iscparser.hh"
 #include "configdata.hh"
+#include "lineindex.hh"
+#include "stats.hh"
+#include "memusage.hh"
+
+/* Longest snippet shown; longer lines are cut around the error. */
+static const size_t snippetWidth = 100;
+
+
+void parse_error::Locate(const char *data, size_t length, size_t offset) {
+	LineIndex index(data, length);
+	const char *text;
+	size_t size, start;
+
+	this->offset=offset;
+	index.Locate(offset, line, column);
+	text=index.Line(line, size);
+
+	start=0;
+	if (size>snippetWidth) {
+		if (column>snippetWidth/2)
+			start=std::min(column-1-snippetWidth/2, size-snippetWidth);
+		size=snippetWidth;
+	}
+	snippet.assign(text+start, size);
+	marker=column-1-start;
+
+	Format();
+}
+
+
+void parse_error::Shift(size_t base, size_t lines, size_t columns) {
+	offset+=base;
+	if (line) {
+		if (line==1)
+			column+=columns;
+		line+=lines;
+	}
+
+	Format();
+}
+
+
+void parse_error::Format() {
+	std::ostringstream out;
+
+	if (!file.empty())
+		out << file << ':';
+	if (line) {
+		if (file.empty())
+			out << "line " << line << ", column " << column << ": ";
+		else
+			out << line << ':' << column << ": ";
+	} else if (!file.empty())
+		out << ' ';
+	out << reason();
+
+	if (line) {
+		out << '\n' << snippet << '\n';
+		// copy tabs so the marker lines up with the snippet
+		for (size_t i=0; i<marker && i<snippet.size(); i++)
+			out << (snippet[i]=='\t' ? '\t' : ' ');
+		out << '^';
+	}
+
+	message=out.str();
+}
+
 
 ISCParser::ISCParser() : state (InMap), cfg(new ConfigData(ConfigData::Map)) {
 	contextStack.push(cfg);
+	STATS_ADD(nodes[ConfigData::Map], 1);
+	MemoryUsage::Track(*cfg);
 }
 
 
@@ -18,11 +89,15 @@ void ISCParser::HandleKeyword(std::string data) {
 		case InSection:
 			{
 			boost::shared_ptr<ConfigData> newmap(new ConfigData(ConfigData::Map));
+			STATS_ADD(nodes[ConfigData::Map], 1);
+			MemoryUsage::Track(*newmap);
+			MemoryUsage::TrackEntry(tokenStack.top());
 			contextStack.top()->mapValue[tokenStack.top()]=newmap;
 			contextStack.push(newmap);
+			STATS_MAX(maxDepth, contextStack.size()-1);
 			}
 			tokenStack.pop();
-			// no break here on purpose!
+			// fall through - no break here on purpose!
 
 		case InMap:
 			tokenStack.push(data);
@@ -40,6 +115,9 @@ void ISCParser::HandleString(std::string data) {
 		case InMapKeyword:
 			{
 				boost::shared_ptr<ConfigData> newvalue(new ConfigData(data));
+				STATS_ADD(nodes[ConfigData::String], 1);
+				MemoryUsage::Track(*newvalue);
+				MemoryUsage::TrackEntry(tokenStack.top());
 				contextStack.top()->mapValue[tokenStack.top()]=newvalue;
 			}
 			tokenStack.pop();
@@ -50,17 +128,18 @@ void ISCParser::HandleString(std::string data) {
 		case InSection:
 			{
 				boost::shared_ptr<ConfigData> newmap(new ConfigData(ConfigData::List));
+				STATS_ADD(nodes[ConfigData::List], 1);
+				MemoryUsage::Track(*newmap);
+				MemoryUsage::TrackEntry(tokenStack.top());
 				contextStack.top()->mapValue[tokenStack.top()]=newmap;
 				contextStack.push(newmap);
+				STATS_MAX(maxDepth, contextStack.size()-1);
 			}
 			tokenStack.pop();
-			// no break here on purpose!
+			// fall through - no break here on purpose!
 
 		case InList:
-			{
-				boost::shared_ptr<ConfigData> newvalue(new ConfigData(data));
-				contextStack.top()->listValue.push_back(newvalue);
-			}
+			contextStack.top()->Append(data.data(), data.size());
 			state=InListNeedTerminator;
 			break;
 
@@ -75,22 +154,35 @@ void ISCParser::HandleInteger(long int data) {
 		case InMapKeyword:
 			{
 				boost::shared_ptr<ConfigData> newvalue(new ConfigData(data));
+				STATS_ADD(nodes[ConfigData::Integer], 1);
+				MemoryUsage::Track(*newvalue);
+				MemoryUsage::TrackEntry(tokenStack.top());
 				contextStack.top()->mapValue[tokenStack.top()]=newvalue;
 			}
 			tokenStack.pop();
 			state=InMapNeedTerminator;
 			break;
 
-		case InList:
+		case InSection:
 			{
-				boost::shared_ptr<ConfigData> newvalue(new ConfigData(data));
-				contextStack.top()->listValue.push_back(newvalue);
+				boost::shared_ptr<ConfigData> newmap(new ConfigData(ConfigData::List));
+				STATS_ADD(nodes[ConfigData::List], 1);
+				MemoryUsage::Track(*newmap);
+				MemoryUsage::TrackEntry(tokenStack.top());
+				contextStack.top()->mapValue[tokenStack.top()]=newmap;
+				contextStack.push(newmap);
+				STATS_MAX(maxDepth, contextStack.size()-1);
 			}
+			tokenStack.pop();
+			// fall through - no break here on purpose!
+
+		case InList:
+			contextStack.top()->Append(static_cast<int>(data));
 			state=InListNeedTerminator;
 			break;
 
 		default:
-			throw parse_error("string not allowed in this context");
+			throw parse_error("integer not allowed in this context");
 	}
 }
 
@@ -112,7 +204,12 @@ void ISCParser::HandleCharacter(char data) {
 			case InSection:
 				{
 					boost::shared_ptr<ConfigData> newmap(new ConfigData(ConfigData::Map));
+					STATS_ADD(nodes[ConfigData::Map], 1);
+					MemoryUsage::Track(*newmap);
+					MemoryUsage::TrackEntry(tokenStack.top());
 					contextStack.top()->mapValue[tokenStack.top()]=newmap;
+					// the ; after the } closes this section again
+					contextStack.push(newmap);
 				}
 				tokenStack.pop();
 				state=EndingSection;
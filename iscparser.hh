@@ -18,13 +18,72 @@
 /** Parse error exception.
  * Standard parse error exception class, thrown when a parse error is
  * encountered.
+ *
+ * Parsers only know what went wrong, not where. ParseConfig and
+ * ReadConfig add the location afterwards using the offset of the
+ * offending token, so finding lines and columns costs nothing unless an
+ * error occurs.
  */
 class parse_error : public std::runtime_error {
 public:
 	/** Default constructor.
 	 * \param arg string description the error in the parser input
 	 */
-	explicit parse_error(const std::string& arg) : std::runtime_error(arg) { }
+	explicit parse_error(const std::string& arg) : std::runtime_error(arg), offset(0), line(0), column(0), marker(0) { }
+
+	virtual ~parse_error() throw() { }
+
+	/** Add the location of the error.
+	 * Builds a LineIndex over the input to translate \a offset into a
+	 * line and column, and keeps the offending line as snippet.
+	 *
+	 * \param data parser input
+	 * \param length size of the parser input
+	 * \param offset byte offset of the offending token
+	 */
+	void Locate(const char *data, size_t length, size_t offset);
+
+	/** Move a location found by Locate().
+	 * Used when the input passed to Locate() was a block taken from a
+	 * larger input.
+	 *
+	 * \param base byte offset of the block in the complete input
+	 * \param lines number of lines before the block
+	 * \param columns number of bytes of the first line of the block
+	 * 	which precede it
+	 */
+	void Shift(size_t base, size_t lines, size_t columns);
+
+	/** Set the name of the input. */
+	void SetFile(const std::string &name) {
+		file=name;
+		Format();
+	}
+
+	/** Return the description of the error without location. */
+	const char *reason() const throw() { return std::runtime_error::what(); }
+
+	/** Return the description of the error.
+	 * If the location is known this includes the file name, line and
+	 * column, followed by the offending line and a marker under the
+	 * offending token.
+	 */
+	virtual const char *what() const throw() {
+		return message.empty() ? reason() : message.c_str();
+	}
+
+	std::string	file;		/*!< name of the input, if known */
+	size_t		offset;		/*!< byte offset of the offending token */
+	size_t		line;		/*!< line number, or 0 if not known */
+	size_t		column;		/*!< column number */
+	std::string	snippet;	/*!< (part of) the offending line */
+	size_t		marker;		/*!< position of the offending token in the snippet */
+
+protected:
+	/** Rebuild the full description. */
+	void Format();
+
+	std::string	message;	/*!< full description */
 };
 
 
@@ -58,6 +117,18 @@ public:
 
 	ISCParser();
 
+	// raw token handlers from ParsedTokenHandler
+	using ParsedTokenHandler::HandleKeyword;
+	using ParsedTokenHandler::HandleString;
+	using ParsedTokenHandler::HandleInteger;
+	using ParsedTokenHandler::HandleCharacter;
+	using ParsedTokenHandler::HandleWhitespace;
+
+	/** Whitespace and comments carry no meaning, so skip them. */
+	virtual unsigned int TokenMask() const {
+		return AllTokens & ~(WhitespaceToken|CommentToken);
+	}
+
 	virtual void HandleKeyword(std::string data);
 	virtual void HandleString(std::string data);
 	virtual void HandleInteger(long int data);
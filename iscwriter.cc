@@ -0,0 +1,268 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include "iscwriter.hh"
+
+
+ISCWriter::ISCWriter(int fd, size_t buffersize) : file(0), fd(fd), buffer(buffersize ? buffersize : 1), used(0) {
+}
+
+
+ISCWriter::ISCWriter(const char *name, size_t buffersize) : file(0), fd(-1), buffer(buffersize ? buffersize : 1), used(0) {
+	file=new File(name, File::Create);
+	fd=file->fileno;
+}
+
+
+ISCWriter::~ISCWriter() {
+	try {
+		Flush();
+	} catch (const system_exception&) {
+	}
+	delete file;
+}
+
+
+/* Write a set of buffers completely, dealing with short writes. */
+static void writeall(int fd, struct iovec *iov, int count) {
+	while (count) {
+		ssize_t len = writev(fd, iov, count);
+
+		if (len==-1) {
+			if (errno==EINTR)
+				continue;
+			throw system_exception("writing configuration");
+		}
+
+		while (count && static_cast<size_t>(len)>=iov->iov_len) {
+			len-=iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count) {
+			iov->iov_base=static_cast<char*>(iov->iov_base)+len;
+			iov->iov_len-=len;
+		}
+	}
+}
+
+
+void ISCWriter::Flush() {
+	struct iovec iov;
+
+	if (!used)
+		return;
+
+	iov.iov_base=&buffer[0];
+	iov.iov_len=used;
+	used=0;
+	writeall(fd, &iov, 1);
+}
+
+
+void ISCWriter::WriteThrough(const char *data, size_t length) {
+	struct iovec iov[2];
+
+	iov[0].iov_base=&buffer[0];
+	iov[0].iov_len=used;
+	iov[1].iov_base=const_cast<char*>(data);
+	iov[1].iov_len=length;
+	used=0;
+	writeall(fd, iov, 2);
+}
+
+
+void ISCWriter::Put(const char *data, size_t length) {
+	while (length) {
+		if (used==buffer.size())
+			Flush();
+
+		size_t chunk = std::min(length, buffer.size()-used);
+		memcpy(&buffer[used], data, chunk);
+		used+=chunk;
+		data+=chunk;
+		length-=chunk;
+	}
+}
+
+
+bool ISCWriter::IsKeyword(const std::string &key) {
+	if (key.empty() || !(isalpha(key[0]) || key[0]=='_'))
+		return false;
+
+	for (std::string::const_iterator i=key.begin(); i!=key.end(); i++)
+		if (!(isalnum(*i) || *i=='_'))
+			return false;
+
+	return true;
+}
+
+
+/* Frame of the explicit stack used to walk nested sections. */
+struct WriterFrame {
+	const ConfigData *node;
+	ConfigData::map_type::const_iterator pos;
+	const std::string *key;
+};
+
+
+/* Build the path of an entry; only needed when reporting errors. */
+static std::string contextpath(const std::vector<WriterFrame> &stack, const std::string &key) {
+	std::string path;
+
+	for (std::vector<WriterFrame>::const_iterator i=stack.begin(); i!=stack.end(); i++)
+		if (i->key)
+			path+=*i->key + "/";
+	return path+key;
+}
+
+
+void ISCWriter::PutValue(const ConfigData &value, const std::vector<WriterFrame> &stack, const std::string &key) {
+	switch (value.type) {
+		case ConfigData::Integer:
+			PutInteger(value.intValue, stack, key);
+			break;
+
+		case ConfigData::String:
+			PutString(value.strValue.data(), value.strValue.size());
+			break;
+
+		default:
+			throw write_error("lists may only contain strings and integers", contextpath(stack, key));
+	}
+}
+
+
+void ISCWriter::PutInteger(int value, const std::vector<WriterFrame> &stack, const std::string &key) {
+	char buf[16];
+
+	if (value<0)
+		throw write_error("negative integers can not be written", contextpath(stack, key));
+	Put(buf, snprintf(buf, sizeof(buf), "%d", value));
+}
+
+
+void ISCWriter::PutString(const char *data, size_t length) {
+	Put('"');
+	if (memchr(data, '"', length) || memchr(data, '\\', length)) {
+		for (const char *end=data+length; data!=end; data++) {
+			if (*data=='"' || *data=='\\')
+				Put('\\');
+			Put(*data);
+		}
+	} else if (length>=buffer.size()/2)
+		WriteThrough(data, length);
+	else
+		Put(data, length);
+	Put('"');
+}
+
+
+void ISCWriter::PutIndent(size_t depth) {
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+	while (depth) {
+		size_t chunk = std::min(depth, sizeof(tabs)-1);
+		Put(tabs, chunk);
+		depth-=chunk;
+	}
+}
+
+
+void ISCWriter::Write(const ConfigData &cfg) {
+	std::vector<WriterFrame> stack;
+	WriterFrame frame;
+
+	if (cfg.type!=ConfigData::Map)
+		throw write_error("configuration root must be a map");
+
+	frame.node=&cfg;
+	frame.pos=cfg.mapValue.begin();
+	frame.key=0;
+	stack.push_back(frame);
+
+	while (!stack.empty()) {
+		WriterFrame &top = stack.back();
+		const size_t depth = stack.size()-1;
+
+		if (top.pos==top.node->mapValue.end()) {
+			stack.pop_back();
+			if (!stack.empty()) {
+				PutIndent(depth-1);
+				Put("};\n", 3);
+				if (depth==1)
+					Put('\n');
+			}
+			continue;
+		}
+
+		const std::string &key = top.pos->first;
+		const ConfigData &value = *top.pos->second;
+		top.pos++;
+
+		if (!IsKeyword(key))
+			throw write_error("key is not a valid keyword", contextpath(stack, key));
+
+		PutIndent(depth);
+		Put(key);
+
+		switch (value.type) {
+			case ConfigData::Integer:
+			case ConfigData::String:
+				Put('\t');
+				PutValue(value, stack, key);
+				Put(";\n", 2);
+				break;
+
+			case ConfigData::List:
+				if (!value.ListSize())
+					throw write_error("empty lists can not be written", contextpath(stack, key));
+
+				Put(" {\n", 3);
+				if (value.packed) {
+					const PackedList &list = *value.packed;
+
+					for (size_t i=0; i<list.size(); i++) {
+						PutIndent(depth+1);
+						if (list.type==ConfigData::Integer)
+							PutInteger(list.integers[i], stack, key);
+						else {
+							size_t length;
+							const char *data = list.String(i, length);
+							PutString(data, length);
+						}
+						Put(";\n", 2);
+					}
+				} else
+					for (ConfigData::list_type::const_iterator i=value.listValue.begin(); i!=value.listValue.end(); i++) {
+						PutIndent(depth+1);
+						PutValue(**i, stack, key);
+						Put(";\n", 2);
+					}
+				PutIndent(depth);
+				Put("};\n", 3);
+				if (depth==0)
+					Put('\n');
+				break;
+
+			case ConfigData::Map:
+				Put(" {\n", 3);
+				frame.node=&value;
+				frame.pos=value.mapValue.begin();
+				frame.key=&key;
+				stack.push_back(frame);
+				break;
+
+			default:
+				throw write_error("entry has no value", contextpath(stack, key));
+		}
+	}
+}
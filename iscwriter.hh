@@ -0,0 +1,127 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_iscwriter_included__
+#define __wta_iscwriter_included__
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "configdata.hh"
+#include "file.hh"
+
+
+/** Write error exception.
+ * Thrown when a ConfigData tree contains something that can not be
+ * represented in an ISC configuration file.
+ */
+class write_error : public std::runtime_error {
+public:
+	/** Default constructor.
+	 * \param arg string describing the problem
+	 * \param ctx path of the offending entry
+	 */
+	explicit write_error(const std::string& arg, const std::string &ctx="") :
+		std::runtime_error(ctx.empty() ? arg : ctx + ": " + arg), context(ctx) { }
+
+	virtual ~write_error() throw() { }
+	std::string context; /*!< path of the offending entry */
+};
+
+
+struct WriterFrame;
+
+
+/** ISC configuration file writer.
+ *
+ * Writes a ConfigData tree in the format read by ISCParser. Sections are
+ * written in key order, so the same tree always produces the same output,
+ * and reading the output back produces an identical tree.
+ *
+ * Output is collected in a fixed size buffer which is written out when it
+ * fills up; long string values bypass the buffer and are written directly
+ * using writev. The complete text is never held in memory.
+ *
+ * Not every tree can be represented: keys must be valid keywords, integers
+ * can not be negative and lists must be non-empty and contain only strings
+ * and integers. A write_error is thrown for trees that violate these rules.
+ * Double quotes and backslashes in strings are written as escape sequences.
+ */
+class ISCWriter : public boost::noncopyable {
+public:
+	/** File descriptor constructor.
+	 * \param fd file descriptor to write to. It is not closed by the writer.
+	 * \param buffersize size of the output buffer
+	 */
+	explicit ISCWriter(int fd, size_t buffersize=256*1024);
+
+	/** File constructor.
+	 * Creates (or truncates) a file and writes to it.
+	 * \param name path of file to write
+	 * \param buffersize size of the output buffer
+	 */
+	explicit ISCWriter(const char *name, size_t buffersize=256*1024);
+
+	/** Destructor.
+	 * Flushes any buffered output. Errors can not be reported from here;
+	 * call Flush() first to see them.
+	 */
+	~ISCWriter();
+
+	/** Write a configuration.
+	 * \param cfg configuration to write. This must be a map.
+	 */
+	void Write(const ConfigData &cfg);
+
+	/** Write all buffered data. */
+	void Flush();
+
+	/** Check if a string is a valid ISC keyword. */
+	static bool IsKeyword(const std::string &key);
+
+protected:
+	/** Add data to the output buffer. */
+	void Put(const char *data, size_t length);
+
+	/** Add a string to the output buffer. */
+	void Put(const std::string &data) { Put(data.data(), data.size()); }
+
+	/** Add a single character to the output buffer. */
+	void Put(char c) {
+		if (used==buffer.size())
+			Flush();
+		buffer[used++]=c;
+	}
+
+	/** Add \a depth tabs to the output buffer. */
+	void PutIndent(size_t depth);
+
+	/** Write a scalar value.
+	 * \param value value to write
+	 * \param stack sections being written, used for error reporting
+	 * \param key key of the value, used for error reporting
+	 */
+	void PutValue(const ConfigData &value, const std::vector<WriterFrame> &stack, const std::string &key);
+
+	/** Write an integer value.
+	 * \sa PutValue
+	 */
+	void PutInteger(int value, const std::vector<WriterFrame> &stack, const std::string &key);
+
+	/** Write a string value, quoted and escaped. */
+	void PutString(const char *data, size_t length);
+
+	/** Write out the buffer followed by \a length bytes of \a data. */
+	void WriteThrough(const char *data, size_t length);
+
+	File			*file;		/*!< file we created, if any */
+	int			fd;		/*!< descriptor output goes to */
+	std::vector<char>	buffer;		/*!< output buffer */
+	size_t			used;		/*!< bytes used in the output buffer */
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <climits>
+#include "jsonparser.hh"
+#include "stats.hh"
+#include "memusage.hh"
+
+JSONParser::JSONParser() : state(ExpectValue), cfg(new ConfigData(ConfigData::Map)) {
+	STATS_ADD(nodes[ConfigData::Map], 1);
+	MemoryUsage::Track(*cfg);
+}
+
+
+void JSONParser::AddValue(const boost::shared_ptr<ConfigData> &value) {
+	if (contextStack.empty())
+		throw parse_error("JSON configuration must be an object");
+	if (!ValueAllowed())
+		throw parse_error("value not allowed in this context");
+
+	ConfigData &context = *contextStack.back();
+
+	if (context.type==ConfigData::Map) {
+		STATS_ADD(nodes[value->type], 1);
+		MemoryUsage::Track(*value);
+		MemoryUsage::TrackEntry(key);
+		context.mapValue[key]=value;
+	} else if (value->type==ConfigData::Integer)
+		context.Append(value->intValue);
+	else if (value->type==ConfigData::String)
+		context.Append(value->strValue.data(), value->strValue.size());
+	else {
+		STATS_ADD(nodes[value->type], 1);
+		MemoryUsage::Track(*value);
+		context.Append(value);
+	}
+
+	if (value->type==ConfigData::Map) {
+		contextStack.push_back(value);
+		STATS_MAX(maxDepth, contextStack.size()-1);
+		state=ExpectKeyOrEnd;
+	} else if (value->type==ConfigData::List) {
+		contextStack.push_back(value);
+		STATS_MAX(maxDepth, contextStack.size()-1);
+		state=ExpectValueOrEnd;
+	} else
+		state=ExpectCommaOrEnd;
+}
+
+
+void JSONParser::HandleInteger(const char *data, size_t length) {
+	size_t i = 0;
+
+	if (i<length && data[i]=='-')
+		i++;
+	if (i==length || data[i]<'0' || data[i]>'9')
+		throw parse_error("invalid number");
+	if (data[i]=='0' && i+1<length && data[i+1]>='0' && data[i+1]<='9')
+		throw parse_error("numbers can not have leading zeros");
+	for (; i<length; i++)
+		if (data[i]<'0' || data[i]>'9') {
+			if (data[i]=='.' || data[i]=='e' || data[i]=='E')
+				throw parse_error("floating point numbers are not supported");
+			throw parse_error("invalid number");
+		}
+
+	ParsedTokenHandler::HandleInteger(data, length);
+}
+
+
+void JSONParser::HandleKeyword(std::string data) {
+	if (data=="true")
+		AddValue(boost::shared_ptr<ConfigData>(new ConfigData(1)));
+	else if (data=="false")
+		AddValue(boost::shared_ptr<ConfigData>(new ConfigData(0)));
+	else if (data=="null")
+		AddValue(boost::shared_ptr<ConfigData>(new ConfigData()));
+	else
+		throw parse_error("unexpected keyword " + data);
+}
+
+
+void JSONParser::HandleString(std::string data) {
+	switch (state) {
+		case ExpectKey:
+		case ExpectKeyOrEnd:
+			key=data;
+			state=ExpectColon;
+			break;
+
+		case ExpectValue:
+		case ExpectValueOrEnd:
+			AddValue(boost::shared_ptr<ConfigData>(new ConfigData(data)));
+			break;
+
+		default:
+			throw parse_error("string not allowed in this context");
+	}
+}
+
+
+void JSONParser::HandleInteger(long int data) {
+	if (data<INT_MIN || data>INT_MAX)
+		throw parse_error("integer out of range");
+	AddValue(boost::shared_ptr<ConfigData>(new ConfigData(data)));
+}
+
+
+void JSONParser::HandleCharacter(char data) {
+	switch (data) {
+		case '{':
+			if (contextStack.empty()) {
+				if (state!=ExpectValue)
+					throw parse_error("Unexpected { found");
+				contextStack.push_back(cfg);
+				state=ExpectKeyOrEnd;
+			} else
+				AddValue(boost::shared_ptr<ConfigData>(new ConfigData(ConfigData::Map)));
+			break;
+
+		case '[':
+			AddValue(boost::shared_ptr<ConfigData>(new ConfigData(ConfigData::List)));
+			break;
+
+		case '}':
+		case ']':
+			if (contextStack.empty() ||
+					(data=='}' && contextStack.back()->type!=ConfigData::Map) ||
+					(data==']' && contextStack.back()->type!=ConfigData::List) ||
+					(state!=ExpectCommaOrEnd && state!=ExpectKeyOrEnd && state!=ExpectValueOrEnd))
+				throw parse_error(std::string("Unexpected ") + data + " found");
+			contextStack.pop_back();
+			state=contextStack.empty() ? Done : ExpectCommaOrEnd;
+			break;
+
+		case ':':
+			if (state!=ExpectColon)
+				throw parse_error("Unexpected : found");
+			state=ExpectValue;
+			break;
+
+		case ',':
+			if (state!=ExpectCommaOrEnd)
+				throw parse_error("Unexpected , found");
+			state=contextStack.back()->type==ConfigData::Map ? ExpectKey : ExpectValue;
+			break;
+
+		default:
+			throw parse_error("Unexpected character found");
+	}
+}
+
+
+void JSONParser::HandleEndOfInput() {
+	if (state!=Done)
+		throw parse_error("Unexpected end of input");
+}
+
+
+void JSONParser::HandleWhitespace(std::string) {
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef _wta_jsonparser_included_
+#define _wta_jsonparser_included_
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "tokenize.hh"
+#include "iscparser.hh"
+#include "configdata.hh"
+
+
+/** JSON configuration parser.
+ *
+ * This class builds ConfigData trees from JSON input tokenized by a
+ * JSONTokenizer, so JSON and ISC configuration files can be used
+ * interchangeably. The top-level value must be an object. Objects become
+ * maps and arrays become lists. Integers and strings map to the
+ * corresponding ConfigData types, true and false become the integers 1 and
+ * 0, and null becomes a Bogus entry. Floating point numbers are not
+ * supported since ConfigData can not store them.
+ *
+ * \sa JSONTokenizer
+ */
+class JSONParser : public ParsedTokenHandler {
+public:
+	/** Possible state machine states. */
+	typedef enum {
+		ExpectValue,		// need a value
+		ExpectValueOrEnd,	// just opened an array: need a value or ]
+		ExpectKey,		// in an object after a comma: need a key
+		ExpectKeyOrEnd,		// just opened an object: need a key or }
+		ExpectColon,		// got a key, need a colon
+		ExpectCommaOrEnd,	// got a value, need a comma or the end of the container
+		Done,			// top-level object has been closed
+	} state_type;
+
+	/** current state of the statemachine. */
+	state_type	state;
+	/** key for the next value in the current object. */
+	std::string	key;
+	/** Stack of objects and arrays being filled. */
+	std::vector<boost::shared_ptr<ConfigData> > contextStack;
+	/** the parsed configuration data. */
+	boost::shared_ptr<ConfigData> cfg;
+
+	JSONParser();
+
+	// raw token handlers from ParsedTokenHandler
+	using ParsedTokenHandler::HandleKeyword;
+	using ParsedTokenHandler::HandleString;
+	using ParsedTokenHandler::HandleCharacter;
+	using ParsedTokenHandler::HandleWhitespace;
+
+	virtual void HandleInteger(const char *data, size_t length);
+
+	virtual void HandleKeyword(std::string data);
+	virtual void HandleString(std::string data);
+	virtual void HandleInteger(long int data);
+	virtual void HandleCharacter(char data);
+	virtual void HandleEndOfInput();
+	virtual void HandleWhitespace(std::string data);
+
+protected:
+	/** Store a new value in the current context. */
+	void AddValue(const boost::shared_ptr<ConfigData> &value);
+
+	/** Check if a value is allowed in the current state. */
+	bool ValueAllowed() const {
+		return state==ExpectValue || state==ExpectValueOrEnd;
+	}
+};
+
+#endif
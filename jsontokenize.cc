@@ -0,0 +1,285 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <cstring>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "jsontokenize.hh"
+
+
+/* Character class bitmasks for a 64 byte block: bit n is set if byte n
+ * of the block is of the given class. */
+struct BlockMasks {
+	uint64_t quote;		/* " */
+	uint64_t backslash;	/* \ */
+	uint64_t op;		/* { } [ ] : , */
+	uint64_t space;		/* space, tab, newline, carriage return */
+};
+
+
+#ifdef __SSE2__
+static inline uint64_t eqmask(const __m128i v[4], char c) {
+	const __m128i needle = _mm_set1_epi8(c);
+
+	return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[0], needle)))) |
+		static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[1], needle))))<<16 |
+		static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[2], needle))))<<32 |
+		static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[3], needle))))<<48;
+}
+
+
+static inline void classify(const char *block, BlockMasks &m) {
+	__m128i v[4];
+
+	for (int i=0; i<4; i++)
+		v[i]=_mm_loadu_si128(reinterpret_cast<const __m128i*>(block+16*i));
+
+	m.quote=eqmask(v, '"');
+	m.backslash=eqmask(v, '\\');
+	m.op=eqmask(v, '{') | eqmask(v, '}') | eqmask(v, '[') | eqmask(v, ']') |
+		eqmask(v, ':') | eqmask(v, ',');
+	m.space=eqmask(v, ' ') | eqmask(v, '\t') | eqmask(v, '\n') | eqmask(v, '\r');
+}
+#else
+static inline void classify(const char *block, BlockMasks &m) {
+	m.quote=m.backslash=m.op=m.space=0;
+
+	for (int i=0; i<64; i++) {
+		const uint64_t bit = static_cast<uint64_t>(1)<<i;
+
+		switch (block[i]) {
+			case '"': m.quote|=bit; break;
+			case '\\': m.backslash|=bit; break;
+			case '{': case '}': case '[': case ']': case ':': case ',':
+				m.op|=bit;
+				break;
+			case ' ': case '\t': case '\n': case '\r':
+				m.space|=bit;
+				break;
+		}
+	}
+}
+#endif
+
+
+/* Turn every bit into the xor of itself and all lower bits. Applied to
+ * the quote mask this gives the mask of bytes inside strings. */
+static inline uint64_t prefixxor(uint64_t x) {
+	x^=x<<1;
+	x^=x<<2;
+	x^=x<<4;
+	x^=x<<8;
+	x^=x<<16;
+	x^=x<<32;
+	return x;
+}
+
+
+/* Return the mask of characters escaped by an odd number of backslashes.
+ * Backslash runs are found by adding their start bits to the backslash
+ * mask: the carry ripples to the first byte after each run, and the parity
+ * of start and end position tells if the run has odd length. carry is set
+ * if the block ends in an odd-length backslash run. */
+static inline uint64_t escaped(uint64_t bs, uint64_t &carry) {
+	const uint64_t even = 0x5555555555555555ULL;
+	const uint64_t odd = ~even;
+
+	uint64_t starts = bs & ~(bs<<1);
+	uint64_t evenstartmask = even ^ carry;
+	uint64_t evenstarts = starts & evenstartmask;
+	uint64_t oddstarts = starts & ~evenstartmask;
+	uint64_t evencarries = bs + evenstarts;
+	uint64_t oddcarries = bs + oddstarts;
+	bool overflow = oddcarries<bs;
+
+	oddcarries|=carry;	// a run continuing from the previous block
+	uint64_t result = ((evencarries & ~bs) & odd) | ((oddcarries & ~bs) & even);
+	carry=overflow ? 1 : 0;
+	return result;
+}
+
+
+void JSONTokenizer::BuildIndex(const char *data, size_t length, std::vector<size_t> &index) {
+	uint64_t escapecarry = 0;	// previous block ended in an odd backslash run
+	uint64_t instring = 0;		// previous block ended inside a string
+	uint64_t predcarry = 1;		// previous byte could precede a value
+	char tail[64];
+
+	index.clear();
+	index.reserve(length/8 + 16);
+
+	for (size_t offset=0; offset<length; offset+=64) {
+		const char *block = data+offset;
+		BlockMasks m;
+
+		if (length-offset<64) {
+			// pad the final block with whitespace
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, block, length-offset);
+			block=tail;
+		}
+
+		classify(block, m);
+
+		uint64_t quotes = m.quote & ~escaped(m.backslash, escapecarry);
+		uint64_t inside = prefixxor(quotes) ^ instring;
+		instring=static_cast<uint64_t>(static_cast<int64_t>(inside)>>63);
+
+		uint64_t op = m.op & ~inside;
+		uint64_t space = m.space & ~inside;
+		uint64_t pred = op | space | quotes;
+		uint64_t valuestart = ((pred<<1) | predcarry) & ~pred & ~inside;
+		predcarry=pred>>63;
+
+		uint64_t structural = op | quotes | valuestart;
+		while (structural) {
+			index.push_back(offset + __builtin_ctzll(structural));
+			structural&=structural-1;
+		}
+	}
+
+	// Bytes added as padding can not appear in the index: they are
+	// whitespace, and the last real byte was already classified.
+	if (instring)
+		throw EofError();
+}
+
+
+static void appendutf8(std::string &out, unsigned long cp) {
+	if (cp<0x80)
+		out+=static_cast<char>(cp);
+	else if (cp<0x800) {
+		out+=static_cast<char>(0xc0 | (cp>>6));
+		out+=static_cast<char>(0x80 | (cp & 0x3f));
+	} else if (cp<0x10000) {
+		out+=static_cast<char>(0xe0 | (cp>>12));
+		out+=static_cast<char>(0x80 | ((cp>>6) & 0x3f));
+		out+=static_cast<char>(0x80 | (cp & 0x3f));
+	} else {
+		out+=static_cast<char>(0xf0 | (cp>>18));
+		out+=static_cast<char>(0x80 | ((cp>>12) & 0x3f));
+		out+=static_cast<char>(0x80 | ((cp>>6) & 0x3f));
+		out+=static_cast<char>(0x80 | (cp & 0x3f));
+	}
+}
+
+
+static unsigned long hex4(const char *data, size_t length, size_t pos) {
+	unsigned long value = 0;
+
+	if (pos+4>length)
+		throw EofError();
+
+	for (int i=0; i<4; i++) {
+		char c = data[pos+i];
+		value<<=4;
+		if (c>='0' && c<='9')
+			value|=c-'0';
+		else if (c>='a' && c<='f')
+			value|=c-'a'+10;
+		else if (c>='A' && c<='F')
+			value|=c-'A'+10;
+		else
+			throw error();
+	}
+	return value;
+}
+
+
+void JSONTokenizer::Unescape(const char *data, size_t length, std::string &out) {
+	out.clear();
+	out.reserve(length);
+
+	for (size_t i=0; i<length; i++) {
+		if (data[i]!='\\') {
+			out+=data[i];
+			continue;
+		}
+
+		if (++i==length)
+			throw EofError();
+
+		switch (data[i]) {
+			case '"': out+='"'; break;
+			case '\\': out+='\\'; break;
+			case '/': out+='/'; break;
+			case 'b': out+='\b'; break;
+			case 'f': out+='\f'; break;
+			case 'n': out+='\n'; break;
+			case 'r': out+='\r'; break;
+			case 't': out+='\t'; break;
+			case 'u':
+				{
+				unsigned long cp = hex4(data, length, i+1);
+				i+=4;
+				if (cp>=0xd800 && cp<0xdc00 && i+2<length && data[i+1]=='\\' && data[i+2]=='u') {
+					unsigned long low = hex4(data, length, i+3);
+					if (low>=0xdc00 && low<0xe000) {
+						cp=0x10000 + ((cp-0xd800)<<10) + (low-0xdc00);
+						i+=6;
+					}
+				}
+				appendutf8(out, cp);
+				break;
+				}
+			default:
+				throw error();
+		}
+	}
+}
+
+
+void JSONTokenizer::operator()(TokenHandler &handler) {
+	std::vector<size_t> index;
+	std::string scratch;
+
+	BuildIndex(input, size, index);
+
+	for (std::vector<size_t>::const_iterator i=index.begin(); i!=index.end(); i++) {
+		const char *start = input + *i;
+
+		token=*i;
+		switch (*start) {
+			case '"':
+				{
+				// The index contains the closing quote as well.
+				if (++i==index.end())
+					throw EofError();
+				const size_t length = *i - (start-input) - 1;
+
+				if (memchr(start+1, '\\', length)) {
+					Unescape(start+1, length, scratch);
+					handler.HandleString(scratch.data(), scratch.size());
+				} else
+					handler.HandleString(start+1, length);
+				break;
+				}
+
+			case '{': case '}': case '[': case ']': case ':': case ',':
+				handler.HandleCharacter(start, 1);
+				break;
+
+			default:
+				{
+				const char *end = start;
+				const char *last = input+size;
+
+				while (end<last && !strchr(" \t\r\n{}[]:,\"", *end))
+					end++;
+
+				if (*start=='-' || (*start>='0' && *start<='9'))
+					handler.HandleInteger(start, end-start);
+				else
+					handler.HandleKeyword(start, end-start);
+				}
+		}
+	}
+
+	token=size;
+	handler.HandleEndOfInput();
+}
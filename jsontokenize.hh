@@ -0,0 +1,84 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_jsontokenize_included__
+#define __wta_jsontokenize_included__
+
+#include <string>
+#include <vector>
+#include "tokenize.hh"
+
+
+/** JSON tokenizer.
+ *
+ * A tokenizer for JSON input which feeds the same TokenHandler interface
+ * as Tokenizer. Tokens are reported as follows:
+ *
+ *  - strings are passed to HandleString with escape sequences decoded
+ *  - numbers are passed to HandleInteger, including any sign, fraction
+ *    or exponent; it is up to the handler to reject what it does not
+ *    support
+ *  - true, false and null are passed to HandleKeyword
+ *  - the structural characters { } [ ] : and , are passed to
+ *    HandleCharacter
+ *
+ * Whitespace is never reported.
+ *
+ * Tokenizing happens in two stages. The first stage builds an index of
+ * the positions of all structural characters, quotes and the starts of
+ * other values, processing 64 bytes at a time using SSE2 where available.
+ * String contents are recognized using bit-parallel tracking of quotes and
+ * backslash runs, so no per-byte branching is needed. The second stage
+ * walks the index and calls the handler.
+ *
+ * \sa Tokenizer
+ * \sa JSONParser
+ */
+class JSONTokenizer {
+public:
+	/** File-reading constructor.
+	 * \param input file to read data from
+	 */
+	JSONTokenizer(MemoryFile &input) : input(input.data), size(input.size), token(0) { }
+
+	/** Memory-reading constructor.
+	 * \param data pointer to memory buffer containing data to tokenize
+	 * \param length size in bytes of buffer to parse.
+	 */
+	JSONTokenizer(const char *data, size_t length) : input(data), size(length), token(0) { }
+
+	/** Run tokenizing loop.
+	 * \param handler token handler containing the parser
+	 */
+	void operator()(TokenHandler &handler);
+
+	/** Return the offset of the current token.
+	 * \sa Tokenizer::offset
+	 */
+	size_t offset() const { return token; }
+
+	/** Build the structural index.
+	 * Fills \a index with the offsets of all structural characters,
+	 * quotes (opening and closing) and the first character of every other
+	 * value in \a data. An EofError is thrown if the input ends inside a
+	 * string.
+	 *
+	 * \param data input to index
+	 * \param length size of the input in bytes
+	 * \param index vector receiving the offsets
+	 */
+	static void BuildIndex(const char *data, size_t length, std::vector<size_t> &index);
+
+protected:
+	/** Decode a string containing escape sequences into \a out. */
+	static void Unescape(const char *data, size_t length, std::string &out);
+
+	const char	*input;	/*!< input buffer */
+	size_t		size;	/*!< size of the input buffer */
+	size_t		token;	/*!< offset of the current token */
+};
+
+#endif
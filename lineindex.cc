@@ -0,0 +1,63 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "lineindex.hh"
+
+
+LineIndex::LineIndex(const char *data, size_t length) : data(data), length(length) {
+	size_t offset = 0;
+
+	starts.push_back(0);
+
+#ifdef __SSE2__
+	const __m128i newline = _mm_set1_epi8('\n');
+
+	for (; offset+16<=length; offset+=16) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data+offset));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+
+		while (mask) {
+			starts.push_back(offset + __builtin_ctz(mask) + 1);
+			mask&=mask-1;
+		}
+	}
+#endif
+
+	for (const char *p; offset<length && (p=static_cast<const char*>(memchr(data+offset, '\n', length-offset))); ) {
+		offset=p-data+1;
+		starts.push_back(offset);
+	}
+}
+
+
+void LineIndex::Locate(size_t offset, size_t &line, size_t &column) const {
+	if (offset>length)
+		offset=length;
+
+	// the last line start at or before offset
+	line=std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin();
+	column=offset - starts[line-1] + 1;
+}
+
+
+const char *LineIndex::Line(size_t line, size_t &size) const {
+	if (line<1 || line>starts.size())
+		throw std::range_error("Line out of range");
+
+	size_t start = starts[line-1];
+	size_t end = line<starts.size() ? starts[line]-1 : length;
+
+	if (end>start && data[end-1]=='\r')
+		end--;
+	size=end-start;
+	return data+start;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_lineindex_included__
+#define __wta_lineindex_included__
+
+#include <cstddef>
+#include <vector>
+
+
+/** Line index for a block of text.
+ *
+ * Translates byte offsets into line and column numbers. The tokenizers
+ * only keep track of byte offsets so the scan loop stays cheap; an index
+ * is built when a location is actually needed, normally only when
+ * reporting an error.
+ *
+ * Lines and columns are counted from 1. Columns count bytes, not
+ * characters.
+ */
+class LineIndex {
+public:
+	/** Build the index.
+	 * \param data text to index. It is not copied and must stay valid
+	 * 	while Line() is used.
+	 * \param length size of the text in bytes
+	 */
+	LineIndex(const char *data, size_t length);
+
+	/** Return the number of lines. */
+	size_t lines() const { return starts.size(); }
+
+	/** Translate an offset into a line and column.
+	 * \param offset byte offset in the text
+	 * \param line set to the line number
+	 * \param column set to the column number
+	 */
+	void Locate(size_t offset, size_t &line, size_t &column) const;
+
+	/** Return a line, without its line terminator.
+	 * \param line line number
+	 * \param length set to the length of the line
+	 * \return start of the line
+	 */
+	const char *Line(size_t line, size_t &length) const;
+
+protected:
+	const char		*data;		/*!< indexed text */
+	size_t			length;		/*!< size of the text */
+	std::vector<size_t>	starts;		/*!< offset of the start of every line */
+};
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include "listindex.hh"
+
+
+const size_t ListIndex::npos;
+
+
+static void makekey(const unsigned char *address, size_t length, uint64_t key[2]) {
+	unsigned char buf[16] = { 0 };
+
+	memcpy(buf, address, length);
+	key[0]=key[1]=0;
+	for (unsigned int i=0; i<8; i++) {
+		key[0]=(key[0]<<8) | buf[i];
+		key[1]=(key[1]<<8) | buf[i+8];
+	}
+}
+
+
+static inline unsigned int bit(const uint64_t key[2], uint32_t index) {
+	return index<64 ? (key[0]>>(63-index))&1 : (key[1]>>(127-index))&1;
+}
+
+
+// Number of leading bits two keys have in common, at most limit.
+static inline uint32_t commonbits(const uint64_t a[2], const uint64_t b[2], uint32_t limit) {
+	uint32_t common;
+
+	if (a[0]!=b[0])
+		common=__builtin_clzll(a[0]^b[0]);
+	else if (a[1]!=b[1])
+		common=64+__builtin_clzll(a[1]^b[1]);
+	else
+		common=128;
+	return std::min(common, limit);
+}
+
+
+uint32_t ListIndex::AddNode(prefix_tree &tree, const uint64_t key[2], uint32_t bits, size_t entry) {
+	PrefixNode node;
+
+	node.key[0]=bits>=64 ? key[0] : bits ? key[0] & ~(~0ULL>>bits) : 0;
+	node.key[1]=bits>=128 ? key[1] : bits>64 ? key[1] & ~(~0ULL>>(bits-64)) : 0;
+	node.bits=bits;
+	node.child[0]=node.child[1]=0;
+	node.entry=entry;
+	tree.push_back(node);
+	return tree.size()-1;
+}
+
+
+ListIndex::ListIndex(const ConfigData &list) : prefixCount(0) {
+	if (list.type!=ConfigData::List)
+		throw type_error("list index on non-list data");
+
+	if (list.IsPacked()) {
+		if (list.packed->type==ConfigData::Integer) {
+			IntegerSpan values = list.Integers();
+			integers.insert(values.begin(), values.end());
+		} else {
+			StringSpan values = list.Strings();
+			strings.rehash(values.size());
+			for (size_t i=0; i<values.size(); i++) {
+				strings.insert(values[i]);
+				AddPrefix(values.c_str(i), values.length(i), i);
+			}
+		}
+		return;
+	}
+
+	for (size_t i=0; i<list.listValue.size(); i++) {
+		const ConfigData &entry = *list.listValue[i];
+
+		if (entry.type==ConfigData::Integer)
+			integers.insert(entry.intValue);
+		else if (entry.type==ConfigData::String) {
+			strings.insert(entry.strValue);
+			AddPrefix(entry.strValue.data(), entry.strValue.size(), i);
+		}
+	}
+}
+
+
+void ListIndex::AddPrefix(const char *data, size_t length, size_t entry) {
+	const char *slash = static_cast<const char*>(memchr(data, '/', length));
+	const size_t addrlen = slash ? slash-data : length;
+	char text[INET6_ADDRSTRLEN];
+	unsigned char address[16];
+	uint64_t key[2];
+	uint32_t bits;
+	prefix_tree *tree;
+
+	if (!addrlen || addrlen>=sizeof(text))
+		return;
+	memcpy(text, data, addrlen);
+	text[addrlen]=0;
+
+	if (inet_pton(AF_INET, text, address)==1) {
+		tree=&ipv4;
+		bits=32;
+		makekey(address, 4, key);
+	} else if (inet_pton(AF_INET6, text, address)==1) {
+		tree=&ipv6;
+		bits=128;
+		makekey(address, 16, key);
+	} else
+		return;
+
+	if (slash) {
+		const char *p = slash+1, *end = data+length;
+		uint32_t prefix = 0;
+
+		if (p==end || end-p>3)
+			return;
+		for (; p!=end; p++) {
+			if (*p<'0' || *p>'9')
+				return;
+			prefix=prefix*10 + (*p-'0');
+		}
+		if (prefix>bits)
+			return;
+		bits=prefix;
+	}
+
+	Insert(*tree, key, bits, entry);
+}
+
+
+void ListIndex::Insert(prefix_tree &tree, const uint64_t key[2], uint32_t bits, size_t entry) {
+	if (tree.empty())
+		AddNode(tree, key, 0, npos);
+
+	// the prefix of node always matches key
+	uint32_t node = 0;
+	for (;;) {
+		if (tree[node].bits==bits) {
+			if (tree[node].entry==npos) {
+				tree[node].entry=entry;
+				prefixCount++;
+			}
+			return;
+		}
+
+		const unsigned int branch = bit(key, tree[node].bits);
+		const uint32_t child = tree[node].child[branch];
+		if (!child) {
+			const uint32_t leaf = AddNode(tree, key, bits, entry);
+			tree[node].child[branch]=leaf;
+			prefixCount++;
+			return;
+		}
+
+		const uint32_t common = commonbits(key, tree[child].key, std::min(bits, tree[child].bits));
+		if (common==tree[child].bits) {
+			node=child;
+			continue;
+		}
+
+		// The new prefix and the child part ways before the child ends:
+		// put a node for their common prefix in between.
+		uint32_t split;
+		if (common==bits)
+			split=AddNode(tree, key, bits, entry);
+		else {
+			split=AddNode(tree, key, common, npos);
+			const uint32_t leaf = AddNode(tree, key, bits, entry);
+			tree[split].child[bit(key, common)]=leaf;
+		}
+		prefixCount++;
+		tree[split].child[bit(tree[child].key, common)]=child;
+		tree[node].child[branch]=split;
+		return;
+	}
+}
+
+
+size_t ListIndex::Lookup(const prefix_tree &tree, const uint64_t key[2], uint32_t bits) {
+	if (tree.empty())
+		return npos;
+
+	size_t best = tree[0].entry;
+	for (uint32_t node=0; tree[node].bits<bits; ) {
+		const uint32_t child = tree[node].child[bit(key, tree[node].bits)];
+		if (!child || commonbits(key, tree[child].key, tree[child].bits)<tree[child].bits)
+			break;
+		if (tree[child].entry!=npos)
+			best=tree[child].entry;
+		node=child;
+	}
+	return best;
+}
+
+
+size_t ListIndex::Match(const unsigned char *address, size_t length) const {
+	uint64_t key[2];
+
+	if (length==4) {
+		makekey(address, 4, key);
+		return Lookup(ipv4, key, 32);
+	} else if (length==16) {
+		makekey(address, 16, key);
+		return Lookup(ipv6, key, 128);
+	}
+	return npos;
+}
+
+
+size_t ListIndex::Match(const char *address) const {
+	unsigned char buf[16];
+
+	if (inet_pton(AF_INET, address, buf)==1)
+		return Match(buf, 4);
+	if (inet_pton(AF_INET6, address, buf)==1)
+		return Match(buf, 16);
+	return npos;
+}
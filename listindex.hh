@@ -0,0 +1,114 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_listindex_included__
+#define __wta_listindex_included__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_set.hpp>
+#include "configdata.hh"
+
+
+/** Membership index for a list.
+ *
+ * Lists are often used as access lists, and checking whether a value is
+ * in one by scanning its entries costs time proportional to the size of
+ * the list. A ListIndex is built once, normally right after loading the
+ * configuration, and answers the same question in constant time.
+ *
+ * Integers and strings are kept in hash sets. Strings which hold an IPv4
+ * or IPv6 address, optionally followed by a prefix length as in
+ * "10.0.0.0/8", are also added to a prefix tree so Match() can find the
+ * most specific entry covering an address in time proportional to the
+ * address length. Host bits beyond the prefix length are ignored.
+ *
+ * The index does not refer to the list after it has been built, but
+ * Match() returns positions in the list it was built from.
+ *
+ * \code
+ * ListIndex trusted(cfg["acl"]["trusted"]);
+ * ...
+ * if (trusted.Match(peer)!=ListIndex::npos)
+ *     ...
+ * \endcode
+ */
+class ListIndex : public boost::noncopyable {
+public:
+	static const size_t npos = static_cast<size_t>(-1);
+
+	/** Build the index.
+	 * Entries which are not integers or strings are ignored.
+	 * \param list list to index
+	 */
+	explicit ListIndex(const ConfigData &list);
+
+	/** Check if the list contains an integer. */
+	bool Contains(int value) const {
+		return integers.find(value)!=integers.end();
+	}
+
+	/** Check if the list contains a string. */
+	bool Contains(const std::string &value) const {
+		return strings.find(value)!=strings.end();
+	}
+
+	/** Find the most specific address or network covering an address.
+	 * \param address IPv4 or IPv6 address in text form
+	 * \return position in the list of the longest matching prefix, or
+	 * 	npos if there is none or \a address is not a valid address.
+	 * 	If a prefix occurs more than once the first one is returned.
+	 */
+	size_t Match(const char *address) const;
+
+	/** Find the most specific address or network covering an address.
+	 * \param address address in network byte order
+	 * \param length size of \a address: 4 for IPv4 or 16 for IPv6
+	 * \sa Match(const char*)
+	 */
+	size_t Match(const unsigned char *address, size_t length) const;
+
+	/** Return the number of indexed prefixes. */
+	size_t prefixes() const { return prefixCount; }
+
+protected:
+	/** Node of a path compressed binary prefix tree.
+	 * Addresses are stored as two 64 bit words, most significant bit
+	 * first, so IPv4 and IPv6 share the same code.
+	 */
+	struct PrefixNode {
+		uint64_t	key[2];		/*!< prefix, bits past \a bits are zero */
+		uint32_t	bits;		/*!< prefix length */
+		uint32_t	child[2];	/*!< children by next bit, 0 if none */
+		size_t		entry;		/*!< list position, or npos for a branch */
+	};
+
+	typedef std::vector<PrefixNode> prefix_tree;
+
+	/** Add a node to a tree.
+	 * \return index of the new node
+	 */
+	static uint32_t AddNode(prefix_tree &tree, const uint64_t key[2], uint32_t bits, size_t entry);
+
+	/** Add a prefix to a tree. */
+	void Insert(prefix_tree &tree, const uint64_t key[2], uint32_t bits, size_t entry);
+
+	/** Look up an address in a tree. */
+	static size_t Lookup(const prefix_tree &tree, const uint64_t key[2], uint32_t bits);
+
+	/** Add a string entry to a prefix tree if it is an address. */
+	void AddPrefix(const char *data, size_t length, size_t entry);
+
+	boost::unordered_set<int>		integers;	/*!< integer entries */
+	boost::unordered_set<std::string>	strings;	/*!< string entries */
+	prefix_tree				ipv4;		/*!< IPv4 prefix tree */
+	prefix_tree				ipv6;		/*!< IPv6 prefix tree */
+	size_t					prefixCount;	/*!< number of prefixes */
+};
+
+#endif
@@ -9,15 +9,7 @@
 #include "tokenize.hh"
 #include "iscparser.hh"
 #include "file.hh"
-
-boost::shared_ptr<ConfigData> ReadConfig(const char *fn) {
-	MemoryFile input(fn);
-	Tokenizer toker(input);
-	ISCParser parser;
-
-	toker(dynamic_cast<TokenHandler&>(parser));
-	return parser.cfg;
-}
+#include "readconfig.hh"
 
 
 int main(int argc, char **argv) {
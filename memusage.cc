@@ -0,0 +1,175 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <cstring>
+#include <set>
+#include <vector>
+#include "memusage.hh"
+
+__thread MemoryUsage *MemoryUsage::tracker = 0;
+
+/* Rough size of a boost::shared_ptr control block: vtable, two counts
+ * and the owned pointer. */
+static const size_t controlblock = 2*sizeof(void*) + 2*sizeof(int);
+
+/* Rough size of a red-black tree node excluding its value: colour and
+ * three links. */
+static const size_t treenode = 4*sizeof(void*);
+
+
+void MemoryUsage::Reset() {
+	memset(nodes, 0, sizeof(nodes));
+	memset(count, 0, sizeof(count));
+	keys=strings=containers=refcounts=0;
+	shared=sharedNodes=0;
+}
+
+
+MemoryUsage &MemoryUsage::operator+=(const MemoryUsage &other) {
+	for (unsigned int i=0; i<5; i++) {
+		nodes[i]+=other.nodes[i];
+		count[i]+=other.count[i];
+	}
+	keys+=other.keys;
+	strings+=other.strings;
+	containers+=other.containers;
+	refcounts+=other.refcounts;
+	shared+=other.shared;
+	sharedNodes+=other.sharedNodes;
+	return *this;
+}
+
+
+size_t MemoryUsage::HeapSize(size_t size) {
+	// malloc adds a size word and rounds to 16 bytes, with a 32 byte minimum
+	size=(size+sizeof(size_t)+15) & ~static_cast<size_t>(15);
+	return size<32 ? 32 : size;
+}
+
+
+size_t MemoryUsage::StringSize(const std::string &str) {
+	// Short strings are stored inside the string object itself.
+	std::string empty;
+
+	if (str.capacity()<=empty.capacity())
+		return 0;
+	return HeapSize(str.capacity()+1);
+}
+
+
+void MemoryUsage::AddNode(const ConfigData &node) {
+	unsigned int type = node.type<5 ? node.type : 0;
+
+	nodes[type]+=HeapSize(sizeof(ConfigData));
+	count[type]++;
+	refcounts+=HeapSize(controlblock);
+	strings+=StringSize(node.strValue);
+}
+
+
+void MemoryUsage::AddEntry(const std::string &key) {
+	containers+=HeapSize(treenode + sizeof(ConfigData::map_type::value_type));
+	keys+=StringSize(key);
+}
+
+
+void MemoryUsage::AddList(size_t count) {
+	containers+=count*sizeof(ConfigData::list_type::value_type);
+}
+
+
+void MemoryUsage::AddPacked(const PackedList &list) {
+	containers+=HeapSize(sizeof(PackedList)) + HeapSize(controlblock);
+	if (list.integers.capacity())
+		containers+=HeapSize(list.integers.capacity()*sizeof(int));
+	if (list.ends.capacity())
+		containers+=HeapSize(list.ends.capacity()*sizeof(size_t));
+	strings+=StringSize(list.strings);
+
+	// nodes created by indexing the list are kept with it
+	if (const ConfigData::list_type *expanded = list.Cached()) {
+		containers+=HeapSize(sizeof(ConfigData::list_type));
+		if (expanded->capacity())
+			containers+=HeapSize(expanded->capacity()*sizeof(ConfigData::list_type::value_type));
+		for (ConfigData::list_type::const_iterator i=expanded->begin(); i!=expanded->end(); i++)
+			AddNode(**i);
+	}
+}
+
+
+unsigned long long MemoryUsage::Total() const {
+	unsigned long long total = keys+strings+containers+refcounts;
+
+	for (int i=0; i<5; i++)
+		total+=nodes[i];
+	return total;
+}
+
+
+MemoryUsage::MemoryUsage(const ConfigData &cfg) {
+	struct Item {
+		const ConfigData *node;
+		bool shared;
+	};
+	std::vector<Item> todo;
+	std::set<const ConfigData*> seen;
+	std::set<const PackedList*> seenPacked;
+	Item item;
+
+	Reset();
+
+	item.node=&cfg;
+	item.shared=false;
+	todo.push_back(item);
+
+	while (!todo.empty()) {
+		item=todo.back();
+		todo.pop_back();
+
+		const ConfigData &node = *item.node;
+		unsigned long long before = Total();
+
+		AddNode(node);
+		if (node.listValue.capacity())
+			containers+=HeapSize(node.listValue.capacity()*sizeof(ConfigData::list_type::value_type));
+		if (node.packed && (node.packed.unique() || seenPacked.insert(node.packed.get()).second))
+			AddPacked(*node.packed);
+		for (ConfigData::map_type::const_iterator i=node.mapValue.begin(); i!=node.mapValue.end(); i++)
+			AddEntry(i->first);
+
+		if (item.shared) {
+			shared+=Total()-before;
+			sharedNodes++;
+		}
+
+		for (ConfigData::map_type::const_iterator i=node.mapValue.begin(); i!=node.mapValue.end(); i++) {
+			Item child = { i->second.get(), item.shared || i->second.use_count()>1 };
+			if (child.shared && !seen.insert(child.node).second)
+				continue;
+			todo.push_back(child);
+		}
+		for (ConfigData::list_type::const_iterator i=node.listValue.begin(); i!=node.listValue.end(); i++) {
+			Item child = { i->get(), item.shared || i->use_count()>1 };
+			if (child.shared && !seen.insert(child.node).second)
+				continue;
+			todo.push_back(child);
+		}
+	}
+}
+
+
+void MemoryUsage::Print(std::ostream &out) const {
+	static const char *nodenames[] = { "bogus", "integer", "string", "list", "map" };
+
+	for (int i=0; i<5; i++)
+		out << "nodes." << nodenames[i] << " " << count[i] << " " << nodes[i] << std::endl;
+	out << "keys " << keys << std::endl;
+	out << "strings " << strings << std::endl;
+	out << "containers " << containers << std::endl;
+	out << "refcounts " << refcounts << std::endl;
+	out << "shared " << sharedNodes << " " << shared << std::endl;
+	out << "total " << Total() << std::endl;
+}
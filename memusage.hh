@@ -0,0 +1,131 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_memusage_included__
+#define __wta_memusage_included__
+
+#include <ostream>
+#include <string>
+#include "configdata.hh"
+
+/** Memory accounting for ConfigData trees.
+ *
+ * Estimates how much heap memory a configuration tree uses, split by
+ * where the memory goes. The numbers are based on the sizes of the
+ * objects involved plus the allocator's per-chunk overhead, so they are
+ * close to, but not exactly, what the allocator really hands out.
+ *
+ * Construct a MemoryUsage from a tree to measure it. A subtree which is
+ * referenced from more than one place (for example because Merge shares
+ * list entries, or because a subtree is shared between trees) is counted
+ * once, and its size is also reported in the shared counter.
+ *
+ * For monitoring a cheaper incremental mode is available: while a
+ * MemoryUsage is made active with a MemoryUsageScope, ISCParser and
+ * ConfigData::Merge add every node and map entry they create to it. The
+ * incremental counters only grow; memory that is released is not
+ * subtracted.
+ */
+struct MemoryUsage {
+	/** Create empty counters. */
+	MemoryUsage() { Reset(); }
+
+	/** Measure a configuration tree.
+	 * \param cfg root of the tree to measure
+	 */
+	explicit MemoryUsage(const ConfigData &cfg);
+
+	/** Reset all counters to zero. */
+	void Reset();
+
+	/** Return the total number of bytes accounted for. */
+	unsigned long long Total() const;
+
+	/** Write a human readable summary. */
+	void Print(std::ostream &out) const;
+
+	/** Account for a single node.
+	 * Adds the node object, its reference count and its string payload.
+	 * Children and container storage are not included.
+	 */
+	void AddNode(const ConfigData &node);
+
+	/** Account for a map entry with the given key. */
+	void AddEntry(const std::string &key);
+
+	/** Account for list storage for \a count entries. */
+	void AddList(size_t count);
+
+	/** Account for the storage of a packed list. */
+	void AddPacked(const PackedList &list);
+
+	/** Add the counters of another instance. */
+	MemoryUsage &operator+=(const MemoryUsage &other);
+
+	/** Estimate heap usage of a single allocation of \a size bytes. */
+	static size_t HeapSize(size_t size);
+
+	/** Estimate heap usage of the character storage of a string. */
+	static size_t StringSize(const std::string &str);
+
+	/** Account for a new node in the active tracker, if any. */
+	static void Track(const ConfigData &node) {
+		if (tracker)
+			tracker->AddNode(node);
+	}
+
+	/** Account for a new map entry in the active tracker, if any. */
+	static void TrackEntry(const std::string &key) {
+		if (tracker)
+			tracker->AddEntry(key);
+	}
+
+	/** Account for a new list entry in the active tracker, if any. */
+	static void TrackListEntry() {
+		if (tracker)
+			tracker->AddList(1);
+	}
+
+	/** Account for \a bytes added to a packed list in the active
+	 * tracker, if any. */
+	static void TrackPackedEntry(size_t bytes) {
+		if (tracker)
+			tracker->containers+=bytes;
+	}
+
+	unsigned long long nodes[5];	/*!< bytes in node objects, indexed by ConfigData::data_type */
+	unsigned long long count[5];	/*!< number of nodes, indexed by ConfigData::data_type */
+	unsigned long long keys;	/*!< bytes of map key storage */
+	unsigned long long strings;	/*!< bytes of string value storage */
+	unsigned long long containers;	/*!< bytes of map nodes and list buffers */
+	unsigned long long refcounts;	/*!< bytes of shared_ptr control blocks */
+	unsigned long long shared;	/*!< bytes in subtrees referenced more than once */
+	unsigned long long sharedNodes;	/*!< number of nodes in shared subtrees */
+
+	/** Incremental tracker for the current thread, if any. */
+	static __thread MemoryUsage *tracker;
+};
+
+
+/** Activate incremental memory accounting.
+ * Makes a MemoryUsage instance the active tracker for the current thread
+ * for the lifetime of the scope object.
+ */
+class MemoryUsageScope {
+public:
+	explicit MemoryUsageScope(MemoryUsage &usage) : previous(MemoryUsage::tracker) {
+		MemoryUsage::tracker=&usage;
+	}
+
+	~MemoryUsageScope() {
+		MemoryUsage::tracker=previous;
+	}
+
+private:
+	MemoryUsage *previous;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+#include "parallel.hh"
+
+
+unsigned int ProcessorCount() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return count>0 ? static_cast<unsigned int>(count) : 1;
+}
+
+
+struct ParallelState {
+	parallel_job	job;
+	void		*context;
+	size_t		count;
+	size_t		next;	/*!< next index to hand out */
+};
+
+
+static void *parallelworker(void *arg) {
+	ParallelState *state = static_cast<ParallelState*>(arg);
+	size_t index;
+
+	while ((index=__sync_fetch_and_add(&state->next, 1))<state->count)
+		state->job(state->context, index);
+
+	return 0;
+}
+
+
+void ParallelFor(size_t count, parallel_job job, void *context, unsigned int threads) {
+	ParallelState state;
+	std::vector<pthread_t> workers;
+
+	state.job=job;
+	state.context=context;
+	state.count=count;
+	state.next=0;
+
+	if (!threads)
+		threads=ProcessorCount();
+	if (threads>count)
+		threads=count;
+
+	for (unsigned int i=1; i<threads; i++) {
+		pthread_t thread;
+
+		// if no more threads can be created run with the ones we have
+		if (pthread_create(&thread, 0, parallelworker, &state))
+			break;
+		workers.push_back(thread);
+	}
+
+	parallelworker(&state);
+
+	for (std::vector<pthread_t>::iterator i=workers.begin(); i!=workers.end(); i++)
+		pthread_join(*i, 0);
+}
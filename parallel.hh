@@ -0,0 +1,37 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_parallel_included__
+#define __wta_parallel_included__
+
+#include <cstddef>
+
+/** Job function for ParallelFor.
+ * \param context context pointer passed to ParallelFor
+ * \param index index of the work item to process
+ */
+typedef void (*parallel_job)(void *context, size_t index);
+
+/** Return the number of online processors. */
+unsigned int ProcessorCount();
+
+/** Run a job for a range of indices on several threads.
+ * Calls \a job for every index in [0, \a count) and returns when all calls
+ * are done. Indices are handed out one at a time, so uneven work items
+ * balance out. The calling thread takes part in the work.
+ *
+ * Jobs must not throw: an exception can not be passed from one thread to
+ * another, so jobs have to record failures in \a context themselves.
+ *
+ * \param count number of work items
+ * \param job function to call for every work item
+ * \param context passed on to \a job
+ * \param threads maximum number of threads to use, including the calling
+ * 	thread. 0 means one per processor.
+ */
+void ParallelFor(size_t count, parallel_job job, void *context, unsigned int threads=0);
+
+#endif
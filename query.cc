@@ -0,0 +1,393 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include "query.hh"
+
+
+/* A path or pattern segment. */
+struct Segment {
+	const char	*data;
+	size_t		length;
+};
+
+
+static void split(const std::string &path, std::vector<Segment> &segments) {
+	const char *start = path.data();
+	const char *end = start+path.size();
+
+	segments.clear();
+	if (start==end)
+		return;
+
+	for (;;) {
+		const char *slash = static_cast<const char*>(memchr(start, '/', end-start));
+		Segment seg;
+
+		seg.data=start;
+		seg.length=(slash ? slash : end)-start;
+		segments.push_back(seg);
+		if (!slash)
+			break;
+		start=slash+1;
+	}
+}
+
+
+static bool isglobstar(const Segment &seg) {
+	return seg.length==2 && seg.data[0]=='*' && seg.data[1]=='*';
+}
+
+
+static bool iswild(const Segment &seg) {
+	return memchr(seg.data, '*', seg.length)!=0;
+}
+
+
+/* Match a single segment against a pattern segment where * matches any
+ * sequence of characters. */
+static bool globmatch(const Segment &pat, const char *str, size_t length) {
+	size_t p = 0, s = 0;
+	size_t star = std::string::npos, mark = 0;
+
+	while (s<length) {
+		if (p<pat.length && pat.data[p]=='*') {
+			star=p++;
+			mark=s;
+		} else if (p<pat.length && pat.data[p]==str[s]) {
+			p++;
+			s++;
+		} else if (star!=std::string::npos) {
+			p=star+1;
+			s=++mark;
+		} else
+			return false;
+	}
+
+	while (p<pat.length && pat.data[p]=='*')
+		p++;
+	return p==pat.length;
+}
+
+
+static bool matchsegments(const std::vector<Segment> &pat, size_t p,
+		const std::vector<Segment> &path, size_t s) {
+	while (p<pat.size()) {
+		if (isglobstar(pat[p])) {
+			// try to let ** absorb 0, 1, ... segments
+			for (size_t skip=s; skip<=path.size(); skip++)
+				if (matchsegments(pat, p+1, path, skip))
+					return true;
+			return false;
+		}
+
+		if (s==path.size() || !globmatch(pat[p], path[s].data, path[s].length))
+			return false;
+		p++;
+		s++;
+	}
+
+	return s==path.size();
+}
+
+
+bool PathMatches(const std::string &pattern, const std::string &path) {
+	std::vector<Segment> pat, segs;
+
+	split(pattern, pat);
+	split(path, segs);
+	return matchsegments(pat, 0, segs, 0);
+}
+
+
+/* Depth first walk for Query(). */
+class QueryWalker {
+public:
+	QueryWalker(const std::vector<Segment> &pattern, QueryResult &result, bool dedup) :
+		pattern(pattern), result(result), dedup(dedup) { }
+
+	void Walk(const ConfigData &node, std::string &path, size_t pos) {
+		if (pos==pattern.size()) {
+			Add(node, path);
+			return;
+		}
+
+		const Segment &seg = pattern[pos];
+		bool globstar = isglobstar(seg);
+
+		if (globstar)
+			Walk(node, path, pos+1);
+
+		const size_t mark = path.size();
+
+		if (node.type==ConfigData::Map) {
+			for (ConfigData::map_type::const_iterator i=node.mapValue.begin(); i!=node.mapValue.end(); i++)
+				if (globstar || globmatch(seg, i->first.data(), i->first.size())) {
+					if (mark)
+						path+='/';
+					path+=i->first;
+					Walk(*i->second, path, globstar ? pos : pos+1);
+					path.resize(mark);
+				}
+		} else if (node.type==ConfigData::List) {
+			const ConfigData::list_type &entries = node.Entries();
+
+			for (size_t i=0; i<entries.size(); i++) {
+				char buf[24];
+				size_t len = snprintf(buf, sizeof(buf), "%lu", static_cast<unsigned long>(i));
+
+				if (globstar || globmatch(seg, buf, len)) {
+					if (mark)
+						path+='/';
+					path.append(buf, len);
+					Walk(*entries[i], path, globstar ? pos : pos+1);
+					path.resize(mark);
+				}
+			}
+		}
+	}
+
+private:
+	void Add(const ConfigData &node, const std::string &path) {
+		if (path.empty())
+			return;
+		if (dedup && !seen.insert(path).second)
+			return;
+
+		QueryMatch match;
+		match.path=path;
+		match.node=&node;
+		result.push_back(match);
+	}
+
+	const std::vector<Segment>	&pattern;
+	QueryResult			&result;
+	bool				dedup;
+	std::set<std::string>		seen;
+};
+
+
+void Query(const ConfigData &cfg, const std::string &pattern, QueryResult &result) {
+	std::vector<Segment> pat;
+	std::string path;
+	unsigned int globstars = 0;
+
+	split(pattern, pat);
+	for (std::vector<Segment>::const_iterator i=pat.begin(); i!=pat.end(); i++)
+		if (isglobstar(*i))
+			globstars++;
+
+	// with more than one ** the same path can be reached in several ways
+	QueryWalker walker(pat, result, globstars>1);
+	walker.Walk(cfg, path, 0);
+}
+
+
+struct EntryPathLess {
+	bool operator()(const PathIndex::Entry &a, const PathIndex::Entry &b) const {
+		return a.path<b.path;
+	}
+
+	bool operator()(const PathIndex::Entry &a, const std::string &b) const {
+		return a.path<b;
+	}
+
+	bool operator()(const std::string &a, const PathIndex::Entry &b) const {
+		return a<b.path;
+	}
+};
+
+
+struct EntryKeyLess {
+	explicit EntryKeyLess(const std::vector<PathIndex::Entry> &entries) : entries(entries) { }
+
+	static int compare(const PathIndex::Entry &e, const char *key, size_t length) {
+		size_t elen = e.path.size()-e.key;
+		int r = memcmp(e.path.data()+e.key, key, std::min(elen, length));
+
+		if (r)
+			return r;
+		return elen<length ? -1 : elen>length ? 1 : 0;
+	}
+
+	bool operator()(size_t a, size_t b) const {
+		const PathIndex::Entry &eb = entries[b];
+		int r = compare(entries[a], eb.path.data()+eb.key, eb.path.size()-eb.key);
+		return r<0 || (r==0 && a<b);
+	}
+
+	bool operator()(size_t a, const std::string &key) const {
+		return compare(entries[a], key.data(), key.size())<0;
+	}
+
+	bool operator()(const std::string &key, size_t b) const {
+		return compare(entries[b], key.data(), key.size())>0;
+	}
+
+	const std::vector<PathIndex::Entry> &entries;
+};
+
+
+PathIndex::PathIndex(const ConfigData &cfg) {
+	struct Item {
+		const ConfigData *node;
+		std::string path;
+	};
+	std::vector<Item> todo;
+	Item item;
+
+	item.node=&cfg;
+	todo.push_back(item);
+
+	while (!todo.empty()) {
+		item=todo.back();
+		todo.pop_back();
+
+		const std::string prefix = item.path.empty() ? item.path : item.path + "/";
+		Item child;
+
+		if (item.node->type==ConfigData::Map) {
+			for (ConfigData::map_type::const_iterator i=item.node->mapValue.begin(); i!=item.node->mapValue.end(); i++) {
+				child.node=i->second.get();
+				child.path=prefix + i->first;
+				todo.push_back(child);
+			}
+		} else if (item.node->type==ConfigData::List) {
+			const ConfigData::list_type &entries = item.node->Entries();
+
+			for (size_t i=0; i<entries.size(); i++) {
+				char buf[24];
+				snprintf(buf, sizeof(buf), "%lu", static_cast<unsigned long>(i));
+				child.node=entries[i].get();
+				child.path=prefix + buf;
+				todo.push_back(child);
+			}
+		}
+
+		if (item.node!=&cfg) {
+			Entry entry;
+			std::string::size_type slash = item.path.rfind('/');
+
+			entry.path=item.path;
+			entry.key=slash==std::string::npos ? 0 : slash+1;
+			entry.node=item.node;
+			entries.push_back(entry);
+		}
+	}
+
+	std::sort(entries.begin(), entries.end(), EntryPathLess());
+
+	bykey.reserve(entries.size());
+	for (size_t i=0; i<entries.size(); i++)
+		bykey.push_back(i);
+	std::sort(bykey.begin(), bykey.end(), EntryKeyLess(entries));
+}
+
+
+const ConfigData *PathIndex::Find(const std::string &path) const {
+	std::vector<Entry>::const_iterator i = std::lower_bound(entries.begin(), entries.end(), path, EntryPathLess());
+
+	if (i==entries.end() || i->path!=path)
+		return 0;
+	return i->node;
+}
+
+
+void PathIndex::Query(const std::string &pattern, QueryResult &result) const {
+	std::vector<Segment> pat, segs;
+	std::string prefix;
+	bool literal = true;
+
+	split(pattern, pat);
+	if (pat.empty())
+		return;
+
+	// Literal start of the pattern, up to the first wildcard.
+	for (std::vector<Segment>::const_iterator i=pat.begin(); i!=pat.end(); i++) {
+		const char *star = static_cast<const char*>(memchr(i->data, '*', i->length));
+
+		if (i!=pat.begin())
+			prefix+='/';
+		if (star) {
+			// ** can match no segments at all, so the entry named by
+			// the prefix itself is a candidate too
+			if (i->length==2 && i->data[1]=='*' && i!=pat.begin())
+				prefix.erase(prefix.size()-1);
+			else
+				prefix.append(i->data, star-i->data);
+			literal=false;
+			break;
+		}
+		prefix.append(i->data, i->length);
+	}
+
+	if (literal) {
+		const ConfigData *node = Find(pattern);
+		if (node) {
+			QueryMatch match;
+			match.path=pattern;
+			match.node=node;
+			result.push_back(match);
+		}
+		return;
+	}
+
+	// Candidates from the path table: everything starting with the prefix.
+	std::vector<Entry>::const_iterator first = std::lower_bound(entries.begin(), entries.end(), prefix, EntryPathLess());
+	std::vector<Entry>::const_iterator last = first;
+	{
+		std::string end = prefix;
+		// the smallest string larger than every string starting with prefix
+		while (!end.empty() && static_cast<unsigned char>(end[end.size()-1])==0xff)
+			end.erase(end.size()-1);
+		if (end.empty())
+			last=entries.end();
+		else {
+			end[end.size()-1]++;
+			last=std::lower_bound(first, entries.end(), end, EntryPathLess());
+		}
+	}
+
+	// Candidates from the key table if the last segment is literal.
+	const Segment &lastseg = pat.back();
+	if (!iswild(lastseg)) {
+		const std::string key(lastseg.data, lastseg.length);
+		std::pair<std::vector<size_t>::const_iterator, std::vector<size_t>::const_iterator> range =
+			std::equal_range(bykey.begin(), bykey.end(), key, EntryKeyLess(entries));
+
+		if (static_cast<size_t>(range.second-range.first)<static_cast<size_t>(last-first)) {
+			std::vector<size_t> hits;
+
+			for (std::vector<size_t>::const_iterator i=range.first; i!=range.second; i++) {
+				split(entries[*i].path, segs);
+				if (matchsegments(pat, 0, segs, 0))
+					hits.push_back(*i);
+			}
+
+			std::sort(hits.begin(), hits.end());
+			for (std::vector<size_t>::const_iterator i=hits.begin(); i!=hits.end(); i++) {
+				QueryMatch match;
+				match.path=entries[*i].path;
+				match.node=entries[*i].node;
+				result.push_back(match);
+			}
+			return;
+		}
+	}
+
+	for (; first!=last; first++) {
+		split(first->path, segs);
+		if (matchsegments(pat, 0, segs, 0)) {
+			QueryMatch match;
+			match.path=first->path;
+			match.node=first->node;
+			result.push_back(match);
+		}
+	}
+}
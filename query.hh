@@ -0,0 +1,116 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_query_included__
+#define __wta_query_included__
+
+#include <string>
+#include <vector>
+#include "configdata.hh"
+
+/** Path queries.
+ *
+ * Entries in a ConfigData tree are addressed by paths: the keys leading
+ * to the entry joined with slashes, for example SQL/radius/database. List
+ * entries are addressed by their index, for example RADIUS/dicts/0.
+ *
+ * A query pattern is a path in which segments may contain wildcards:
+ *
+ *  - \c * within a segment matches any sequence of characters within that
+ *    segment, so \c * matches any single key and \c ra* any key starting
+ *    with ra
+ *  - a segment consisting of \c ** matches zero or more complete segments
+ *
+ * For example SQL/ * /database finds the database setting in every SQL
+ * subsection and ** /server finds every entry named server anywhere in
+ * the tree.
+ *
+ * Keys which contain a slash can not be matched reliably.
+ */
+
+/** A single query result. */
+struct QueryMatch {
+	std::string		path;	/*!< path of the matching entry */
+	const ConfigData	*node;	/*!< matching entry */
+};
+
+/** List of query results. */
+typedef std::vector<QueryMatch> QueryResult;
+
+
+/** Query a tree.
+ * Walks the tree and collects all entries matching a pattern. Only the
+ * parts of the tree which can match are visited, but a pattern starting
+ * with a wildcard has to look at the whole tree. Use a PathIndex to run
+ * many queries over the same tree.
+ *
+ * Results point to nodes, so packed lists which are visited are expanded,
+ * see ConfigData::Entries().
+ *
+ * \param cfg tree to search
+ * \param pattern query pattern
+ * \param result vector to which matches are added, in tree order
+ */
+void Query(const ConfigData &cfg, const std::string &pattern, QueryResult &result);
+
+/** Check if a path matches a query pattern.
+ * \param pattern query pattern
+ * \param path path to check
+ */
+bool PathMatches(const std::string &pattern, const std::string &path);
+
+
+/** Path index for fast repeated queries.
+ *
+ * A PathIndex is a table of the paths of all entries in a tree, sorted by
+ * path, together with a table of all entries sorted by their last key.
+ * Queries use whichever table gives the fewest candidates: a pattern with a
+ * literal start (SQL/ *) becomes a range lookup in the path table, and a
+ * pattern with a literal last key (** /server) a lookup in the key table.
+ * Only those candidates are matched against the pattern, so the cost of a
+ * query depends on the number of candidates instead of the size of the tree.
+ *
+ * The index stores pointers into the tree: it must be rebuilt if the tree
+ * is modified, and must not outlive it. Building it expands every packed
+ * list in the tree.
+ */
+class PathIndex {
+public:
+	/** Build an index.
+	 * \param cfg tree to index
+	 */
+	explicit PathIndex(const ConfigData &cfg);
+
+	/** Run a query.
+	 * \param pattern query pattern
+	 * \param result vector to which matches are added, sorted by path
+	 */
+	void Query(const std::string &pattern, QueryResult &result) const;
+
+	/** Find the entry with an exact path.
+	 * \return the entry, or 0 if there is no entry with this path
+	 */
+	const ConfigData *Find(const std::string &path) const;
+
+	/** Return the number of indexed entries. */
+	size_t size() const { return entries.size(); }
+
+protected:
+	/** Indexed entry. */
+	struct Entry {
+		std::string		path;	/*!< full path */
+		size_t			key;	/*!< offset of the last key in path */
+		const ConfigData	*node;	/*!< the entry */
+	};
+
+	std::vector<Entry>	entries;	/*!< all entries, sorted by path */
+	std::vector<size_t>	bykey;		/*!< entry numbers, sorted by last key */
+
+	friend struct EntryPathLess;
+	friend struct EntryKeyLess;
+};
+
+#endif
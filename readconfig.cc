@@ -0,0 +1,146 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <vector>
+#include "readconfig.hh"
+#include "tokenize.hh"
+#include "iscparser.hh"
+#include "jsontokenize.hh"
+#include "jsonparser.hh"
+#include "decompress.hh"
+
+
+config_format DetectFormat(const char *data, size_t length) {
+	for (size_t i=0; i<length; i++)
+		if (!isspace(static_cast<unsigned char>(data[i])))
+			return data[i]=='{' ? JSONFormat : ISCFormat;
+
+	return ISCFormat;
+}
+
+
+/* Parse uncompressed configuration text. */
+static boost::shared_ptr<ConfigData> ParseText(const char *data, size_t length, config_format format) {
+	if (format==AutoFormat)
+		format=DetectFormat(data, length);
+
+	if (format==JSONFormat) {
+		JSONTokenizer toker(data, length);
+		JSONParser parser;
+
+		try {
+			toker(parser);
+		} catch (parse_error &e) {
+			e.Locate(data, length, toker.offset());
+			throw;
+		}
+		return parser.cfg;
+	} else {
+		Tokenizer toker(data, length);
+		ISCParser parser;
+
+		try {
+			toker(parser);
+		} catch (parse_error &e) {
+			e.Locate(data, length, toker.offset());
+			throw;
+		}
+		return parser.cfg;
+	}
+}
+
+
+/* Size of the blocks in which compressed input is decompressed. */
+static const size_t streamBlock = 256*1024;
+
+
+/* Parse compressed configuration data. ISC input is decompressed in
+ * blocks which are fed to the tokenizer as they come; only the tail of
+ * a block which may hold an incomplete token is carried over. JSON input
+ * is decompressed completely since JSONTokenizer indexes the whole
+ * input before parsing. */
+static boost::shared_ptr<ConfigData> ParseCompressed(Decompressor::compression_type type, const char *data, size_t length, config_format format) {
+	boost::shared_ptr<Decompressor> source = Decompressor::Create(type, data, length);
+	std::vector<char> buffer(streamBlock);
+	size_t have = source->Read(&buffer[0], buffer.size());
+
+	if (format==AutoFormat)
+		format=DetectFormat(&buffer[0], have);
+
+	if (format==JSONFormat) {
+		size_t got;
+
+		do {
+			buffer.resize(have+streamBlock);
+			got=source->Read(&buffer[have], streamBlock);
+			have+=got;
+		} while (got);
+		return ParseText(&buffer[0], have, format);
+	}
+
+	ISCParser parser;
+	size_t base = 0, lines = 0, columns = 0;
+
+	for (;;) {
+		const bool last = have<buffer.size();
+		Tokenizer toker(&buffer[0], have);
+		size_t used;
+
+		try {
+			if (last) {
+				toker.Tokenize(parser);
+				break;
+			}
+			used=toker.TokenizePartial(parser);
+		} catch (parse_error &e) {
+			e.Locate(&buffer[0], have, toker.offset());
+			e.Shift(base, lines, columns);
+			throw;
+		}
+
+		// keep track of lines for error locations
+		const char *nl = static_cast<const char*>(memrchr(&buffer[0], '\n', used));
+		if (nl) {
+			lines+=std::count(static_cast<const char*>(&buffer[0]), nl+1, '\n');
+			columns=&buffer[0]+used-nl-1;
+		} else
+			columns+=used;
+		base+=used;
+
+		// carry over the unused tail; a token may be longer than a block
+		memmove(&buffer[0], &buffer[used], have-used);
+		have-=used;
+		if (buffer.size()-have<streamBlock/2)
+			buffer.resize(buffer.size()+streamBlock);
+		have+=source->Read(&buffer[have], buffer.size()-have);
+	}
+
+	return parser.cfg;
+}
+
+
+boost::shared_ptr<ConfigData> ParseConfig(const char *data, size_t length, config_format format) {
+	Decompressor::compression_type type = Decompressor::Detect(data, length);
+
+	if (type!=Decompressor::None)
+		return ParseCompressed(type, data, length, format);
+	return ParseText(data, length, format);
+}
+
+
+boost::shared_ptr<ConfigData> ReadConfig(const char *fn, config_format format) {
+	MemoryFile input(fn);
+
+	try {
+		return ParseConfig(input.data, input.size, format);
+	} catch (parse_error &e) {
+		e.SetFile(fn);
+		throw;
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_readconfig_included__
+#define __wta_readconfig_included__
+
+#include <boost/shared_ptr.hpp>
+#include "configdata.hh"
+#include "file.hh"
+
+/** Configuration file formats. */
+enum config_format {
+	AutoFormat,	/*!< detect the format from the file contents */
+	ISCFormat,	/*!< ISC style configuration, as read by ISCParser */
+	JSONFormat,	/*!< JSON, as read by JSONParser */
+};
+
+/** Detect the format of a configuration file.
+ * A file whose first non-whitespace character is { is JSON: that can not
+ * start a valid ISC file. Everything else is treated as ISC.
+ *
+ * \param data file contents
+ * \param length size of the file contents
+ * \return detected format
+ */
+config_format DetectFormat(const char *data, size_t length);
+
+/** Read a configuration file.
+ * Reads and parses a configuration file in either ISC or JSON format.
+ * Compressed files are recognized and decompressed while parsing; see
+ * ParseConfig.
+ * Parse errors are reported with a parse_error exception which includes
+ * the file name, line and column; unexpected ends of the input with
+ * EofError.
+ *
+ * \param fn path of file to read
+ * \param format format of the file
+ * \return the parsed configuration
+ */
+boost::shared_ptr<ConfigData> ReadConfig(const char *fn, config_format format=AutoFormat);
+
+/** Parse configuration data in memory.
+ * Parse errors are reported with a parse_error exception which includes
+ * the line and column.
+ *
+ * gzip and zstd compressed data is recognized by its magic bytes (see
+ * Decompressor). ISC input is decompressed in blocks which are fed
+ * straight to the parser, so the decompressed text is never held in
+ * memory as a whole. Compressed JSON is decompressed completely first.
+ *
+ * \param data configuration text
+ * \param length size of the configuration text
+ * \param format format of the configuration
+ * \return the parsed configuration
+ */
+boost::shared_ptr<ConfigData> ParseConfig(const char *data, size_t length, config_format format=AutoFormat);
+
+#endif
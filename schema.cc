@@ -0,0 +1,259 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include "schema.hh"
+
+
+SchemaBase::SchemaBase() : nodes(1) {
+	nodes[0].kind=NoValue;
+	nodes[0].member=0;
+}
+
+
+int SchemaBase::Child(unsigned int node, const char *key, size_t length) const {
+	const std::vector<std::pair<std::string, unsigned int> > &children = nodes[node].children;
+
+	for (std::vector<std::pair<std::string, unsigned int> >::const_iterator i=children.begin(); i!=children.end(); i++)
+		if (i->first.size()==length && !memcmp(i->first.data(), key, length))
+			return i->second;
+
+	return -1;
+}
+
+
+void SchemaBase::AddBinding(const char *path, value_kind kind, unsigned int member) {
+	unsigned int node = 0;
+	const char *start = path;
+
+	for (;;) {
+		const char *end = strchr(start, '/');
+		size_t length = end ? static_cast<size_t>(end-start) : strlen(start);
+		int child;
+
+		if (!length)
+			throw std::invalid_argument(std::string("invalid schema path ") + path);
+		if (nodes[node].kind!=NoValue)
+			throw std::invalid_argument(std::string("schema path below a setting: ") + path);
+
+		if ((child=Child(node, start, length))==-1) {
+			Node n;
+
+			n.kind=NoValue;
+			n.member=0;
+			n.path=std::string(path, start+length);
+			nodes.push_back(n);
+			child=nodes.size()-1;
+			nodes[node].children.push_back(std::make_pair(std::string(start, length), child));
+		}
+		node=child;
+
+		if (!end)
+			break;
+		start=end+1;
+	}
+
+	if (nodes[node].kind!=NoValue || !nodes[node].children.empty())
+		throw std::invalid_argument(std::string("schema path bound twice: ") + path);
+
+	nodes[node].kind=kind;
+	nodes[node].member=member;
+}
+
+
+static const char *kindname(SchemaBase::value_kind kind) {
+	switch (kind) {
+		case SchemaBase::IntValue: return "integer";
+		case SchemaBase::StringValue: return "string";
+		case SchemaBase::IntListValue: return "list of integers";
+		case SchemaBase::StringListValue: return "list of strings";
+		default: return "section";
+	}
+}
+
+
+SchemaParser::SchemaParser(const SchemaBase &schema) : schema(schema), state(InMap), pending(-1) {
+	Section root;
+
+	root.node=0;
+	root.list=false;
+	sections.push_back(root);
+}
+
+
+const SchemaBase::Node *SchemaParser::Setting(int node, SchemaBase::value_kind kind, const char *found) {
+	if (node==-1)
+		return 0;
+
+	const SchemaBase::Node &n = schema.node(node);
+	if (n.kind!=kind)
+		throw parse_error(n.path + ": " + kindname(n.kind) + " expected, found " + found);
+	return &n;
+}
+
+
+void SchemaParser::OpenSection(bool list) {
+	Section section;
+
+	section.node=pending;
+	section.list=list;
+
+	if (pending!=-1) {
+		const SchemaBase::Node &n = schema.node(pending);
+
+		if (list) {
+			if (n.kind!=SchemaBase::IntListValue && n.kind!=SchemaBase::StringListValue)
+				throw parse_error(n.path + ": " + kindname(n.kind) + " expected, found list");
+			ClearList(n.kind, n.member);
+		} else if (n.kind!=SchemaBase::NoValue)
+			throw parse_error(n.path + ": " + kindname(n.kind) + " expected, found section");
+	}
+
+	sections.push_back(section);
+}
+
+
+void SchemaParser::HandleKeyword(const char *data, size_t length) {
+	switch (state) {
+		case InSection:
+			OpenSection(false);
+			// fall through - no break here on purpose!
+
+		case InMap:
+			{
+			const int parent = sections.back().node;
+			pending=parent==-1 ? -1 : schema.Child(parent, data, length);
+			state=InMapKeyword;
+			break;
+			}
+
+		default:
+			throw parse_error("keyword not allowed in this context");
+	}
+}
+
+
+void SchemaParser::HandleString(const char *data, size_t length) {
+	const SchemaBase::Node *n;
+
+	switch (state) {
+		case InMapKeyword:
+			if ((n=Setting(pending, SchemaBase::StringValue, "string")))
+				SetString(n->member, data, length);
+			state=InMapNeedTerminator;
+			break;
+
+		case InSection:
+			OpenSection(true);
+			// fall through - no break here on purpose!
+
+		case InList:
+			if ((n=Setting(sections.back().node, SchemaBase::StringListValue, "string")))
+				AppendString(n->member, data, length);
+			state=InListNeedTerminator;
+			break;
+
+		default:
+			throw parse_error("string not allowed in this context");
+	}
+}
+
+
+void SchemaParser::HandleInteger(const char *data, size_t length) {
+	const SchemaBase::Node *n;
+	long int value;
+
+	if (!ParsedTokenHandler::ParseInteger(data, length, value) || value<INT_MIN || value>INT_MAX)
+		throw parse_error("integer out of range");
+
+	switch (state) {
+		case InMapKeyword:
+			if ((n=Setting(pending, SchemaBase::IntValue, "integer")))
+				SetInt(n->member, value);
+			state=InMapNeedTerminator;
+			break;
+
+		case InSection:
+			OpenSection(true);
+			// fall through - no break here on purpose!
+
+		case InList:
+			if ((n=Setting(sections.back().node, SchemaBase::IntListValue, "integer")))
+				AppendInt(n->member, value);
+			state=InListNeedTerminator;
+			break;
+
+		default:
+			throw parse_error("integer not allowed in this context");
+	}
+}
+
+
+void SchemaParser::HandleCharacter(const char *data, size_t) {
+	switch (*data) {
+		case '{':
+			if (state!=InMapKeyword)
+				throw parse_error("Unexpected { found");
+			state=InSection;
+			break;
+
+		case '}':
+			switch (state) {
+				case InSection:
+					// empty section: it may still clear a list
+					if (pending!=-1 && (schema.node(pending).kind==SchemaBase::IntListValue ||
+								schema.node(pending).kind==SchemaBase::StringListValue))
+						OpenSection(true);
+					else
+						OpenSection(false);
+					sections.pop_back();
+					break;
+
+				case InMap:
+				case InList:
+					if (sections.size()<=1)
+						throw parse_error("Can not close the root section");
+					sections.pop_back();
+					break;
+
+				default:
+					throw parse_error("Unexpected } found");
+			}
+			state=EndingSection;
+			break;
+
+		case ';':
+			switch (state) {
+				case InMapNeedTerminator:
+				case EndingSection:
+					state=InMap;
+					break;
+
+				case InListNeedTerminator:
+					state=InList;
+					break;
+
+				default:
+					throw parse_error("Unexpected seperator (;) found");
+			}
+			break;
+
+		default:
+			throw parse_error("Unexpected character found");
+	}
+}
+
+
+void SchemaParser::HandleWhitespace(const char *, size_t) {
+}
+
+
+void SchemaParser::HandleEndOfInput() {
+	if (state!=InMap || sections.size()!=1)
+		throw parse_error("Unexpected end of input");
+}
@@ -0,0 +1,300 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_schema_included__
+#define __wta_schema_included__
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "tokenize.hh"
+#include "iscparser.hh"
+#include "file.hh"
+
+
+/** Untyped part of a Schema.
+ *
+ * Holds the tree of bound paths. Every node in the tree is a section or
+ * a setting; settings refer to a member of the target structure through
+ * the typed Schema class.
+ */
+class SchemaBase {
+public:
+	/** Types of values which can be bound. */
+	enum value_kind {
+		NoValue,		/*!< a section, not a setting */
+		IntValue,		/*!< int */
+		StringValue,		/*!< std::string */
+		IntListValue,		/*!< std::vector<int> */
+		StringListValue		/*!< std::vector<std::string> */
+	};
+
+	/** Node in the path tree. */
+	struct Node {
+		std::vector<std::pair<std::string, unsigned int> > children;	/*!< subsections and settings */
+		value_kind	kind;		/*!< type of the setting */
+		unsigned int	member;		/*!< index of the member pointer for the setting */
+		std::string	path;		/*!< full path, for error messages */
+	};
+
+	SchemaBase();
+
+	/** Look up a section or setting.
+	 * \param node index of the parent node
+	 * \param key name of the section or setting
+	 * \param length length of \a key
+	 * \return index of the node, or -1 if the key is not part of the schema
+	 */
+	int Child(unsigned int node, const char *key, size_t length) const;
+
+	/** Return a node. */
+	const Node &node(unsigned int index) const { return nodes[index]; }
+
+protected:
+	/** Add a setting.
+	 * \param path slash separated path of the setting, for example
+	 * 	RADIUS/server/port
+	 * \param kind type of the setting
+	 * \param member index of the member pointer
+	 */
+	void AddBinding(const char *path, value_kind kind, unsigned int member);
+
+	std::vector<Node>	nodes;	/*!< path tree; node 0 is the root */
+};
+
+
+/** Schema binding configuration paths to structure members.
+ *
+ * A schema describes which settings of an ISC configuration file go into
+ * which member of a structure. The type of every setting follows from the
+ * type of its member, so a SchemaHandler can check types while parsing.
+ * Settings which are not part of the schema are ignored.
+ *
+ * A schema is normally built once and then used for every file:
+ *
+ * \code
+ * struct Settings {
+ *     std::string logdir;
+ *     int port;
+ *     std::vector<std::string> dicts;
+ * };
+ *
+ * static const Schema<Settings> schema = Schema<Settings>()
+ *     .Bind("CGI/logdir", &Settings::logdir)
+ *     .Bind("RADIUS/server/port", &Settings::port)
+ *     .Bind("RADIUS/dicts", &Settings::dicts);
+ * \endcode
+ */
+template<class Struct>
+class Schema : public SchemaBase {
+public:
+	/** Bind an integer setting. */
+	Schema &Bind(const char *path, int Struct::*member) {
+		ints.push_back(member);
+		AddBinding(path, IntValue, ints.size()-1);
+		return *this;
+	}
+
+	/** Bind a string setting. */
+	Schema &Bind(const char *path, std::string Struct::*member) {
+		strings.push_back(member);
+		AddBinding(path, StringValue, strings.size()-1);
+		return *this;
+	}
+
+	/** Bind a list of integers. */
+	Schema &Bind(const char *path, std::vector<int> Struct::*member) {
+		intlists.push_back(member);
+		AddBinding(path, IntListValue, intlists.size()-1);
+		return *this;
+	}
+
+	/** Bind a list of strings. */
+	Schema &Bind(const char *path, std::vector<std::string> Struct::*member) {
+		stringlists.push_back(member);
+		AddBinding(path, StringListValue, stringlists.size()-1);
+		return *this;
+	}
+
+	std::vector<int Struct::*>				ints;
+	std::vector<std::string Struct::*>			strings;
+	std::vector<std::vector<int> Struct::*>			intlists;
+	std::vector<std::vector<std::string> Struct::*>		stringlists;
+};
+
+
+/** Untyped part of a SchemaHandler.
+ *
+ * This is the ISC state machine. It follows the same grammar as
+ * ISCParser, but instead of building a tree it looks every setting up in
+ * the schema and hands its value to the typed SchemaHandler.
+ */
+class SchemaParser : public TokenHandler {
+public:
+	/** Whitespace and comments carry no meaning, so skip them. */
+	virtual unsigned int TokenMask() const {
+		return AllTokens & ~(WhitespaceToken|CommentToken);
+	}
+
+	virtual void HandleString(const char *data, size_t length);
+	virtual void HandleInteger(const char *data, size_t length);
+	virtual void HandleKeyword(const char *data, size_t length);
+	virtual void HandleCharacter(const char *data, size_t length);
+	virtual void HandleWhitespace(const char *data, size_t length);
+	virtual void HandleEndOfInput();
+
+protected:
+	explicit SchemaParser(const SchemaBase &schema);
+
+	/** Possible state machine states; see ISCParser. */
+	enum state_type {
+		InSection,
+		InMap,
+		InMapKeyword,
+		InMapNeedTerminator,
+		InList,
+		InListNeedTerminator,
+		EndingSection
+	};
+
+	/** An open section. */
+	struct Section {
+		int	node;	/*!< schema node, or -1 for sections not in the schema */
+		bool	list;	/*!< list section */
+	};
+
+	/** Start a section for the pending key. */
+	void OpenSection(bool list);
+
+	/** Check the type of a value for schema node \a node.
+	 * \param node schema node, or -1
+	 * \param kind type of setting the value is valid for
+	 * \param found description of the value, for errors
+	 * \return the schema node, or 0 if the value is not part of the schema
+	 */
+	const SchemaBase::Node *Setting(int node, SchemaBase::value_kind kind, const char *found);
+
+	virtual void SetInt(unsigned int member, int value) = 0;
+	virtual void SetString(unsigned int member, const char *data, size_t length) = 0;
+	virtual void ClearList(SchemaBase::value_kind kind, unsigned int member) = 0;
+	virtual void AppendInt(unsigned int member, int value) = 0;
+	virtual void AppendString(unsigned int member, const char *data, size_t length) = 0;
+
+	const SchemaBase	&schema;
+	state_type		state;		/*!< current state of the statemachine */
+	int			pending;	/*!< schema node of the last key, or -1 */
+	std::vector<Section>	sections;	/*!< open sections, the root first */
+};
+
+
+/** Token handler filling a structure.
+ *
+ * Parses an ISC configuration and stores the settings bound in a Schema
+ * straight into a structure, without building a ConfigData tree. Values
+ * of the wrong type are reported with a parse_error. Members for settings
+ * which are missing from the input keep their value, so defaults can be
+ * set by initializing the structure first, or with the defaults
+ * constructor. A list in the input replaces the whole list member.
+ *
+ * \code
+ * Settings settings;
+ * SchemaHandler<Settings> handler(schema, settings, defaults);
+ * Tokenizer(input).Tokenize(handler);
+ * \endcode
+ *
+ * \sa ParseInto, ReadInto
+ */
+template<class Struct>
+class SchemaHandler : public SchemaParser {
+public:
+	/** Standard constructor.
+	 * \param schema schema to use. It is not copied.
+	 * \param target structure to fill
+	 */
+	SchemaHandler(const Schema<Struct> &schema, Struct &target) :
+		SchemaParser(schema), typed(schema), target(target) { }
+
+	/** Defaults constructor.
+	 * Like the standard constructor, but first copies \a defaults into
+	 * \a target.
+	 */
+	SchemaHandler(const Schema<Struct> &schema, Struct &target, const Struct &defaults) :
+		SchemaParser(schema), typed(schema), target(target) {
+		target=defaults;
+	}
+
+protected:
+	virtual void SetInt(unsigned int member, int value) {
+		target.*typed.ints[member]=value;
+	}
+
+	virtual void SetString(unsigned int member, const char *data, size_t length) {
+		(target.*typed.strings[member]).assign(data, length);
+	}
+
+	virtual void ClearList(SchemaBase::value_kind kind, unsigned int member) {
+		if (kind==SchemaBase::IntListValue)
+			(target.*typed.intlists[member]).clear();
+		else
+			(target.*typed.stringlists[member]).clear();
+	}
+
+	virtual void AppendInt(unsigned int member, int value) {
+		(target.*typed.intlists[member]).push_back(value);
+	}
+
+	virtual void AppendString(unsigned int member, const char *data, size_t length) {
+		(target.*typed.stringlists[member]).push_back(std::string(data, length));
+	}
+
+	const Schema<Struct>	&typed;
+	Struct			&target;
+};
+
+
+/** Parse configuration data into a structure.
+ * Parse errors are reported with a parse_error exception which includes
+ * the line and column.
+ *
+ * \param data configuration text
+ * \param length size of the configuration text
+ * \param schema schema to use
+ * \param target structure to fill
+ */
+template<class Struct>
+void ParseInto(const char *data, size_t length, const Schema<Struct> &schema, Struct &target) {
+	Tokenizer toker(data, length);
+	SchemaHandler<Struct> handler(schema, target);
+
+	try {
+		toker.Tokenize(handler);
+	} catch (parse_error &e) {
+		e.Locate(data, length, toker.offset());
+		throw;
+	}
+}
+
+
+/** Read a configuration file into a structure.
+ * \sa ParseInto
+ *
+ * \param fn path of file to read
+ * \param schema schema to use
+ * \param target structure to fill
+ */
+template<class Struct>
+void ReadInto(const char *fn, const Schema<Struct> &schema, Struct &target) {
+	MemoryFile input(fn);
+
+	try {
+		ParseInto(input.data, input.size, schema, target);
+	} catch (parse_error &e) {
+		e.SetFile(fn);
+		throw;
+	}
+}
+
+#endif
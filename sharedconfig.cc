@@ -0,0 +1,211 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include "sharedconfig.hh"
+#include "file.hh"
+
+
+/* Name of the segment holding the image of a generation. */
+static std::string SegmentName(const std::string &name, uint64_t gen) {
+	char buf[24];
+
+	snprintf(buf, sizeof(buf), ".%llu", static_cast<unsigned long long>(gen));
+	return name+buf;
+}
+
+
+/* A FrozenConfig using a mapped shared memory segment. */
+class MappedFrozenConfig : public FrozenConfig {
+public:
+	MappedFrozenConfig(void *mapping, size_t length) :
+		FrozenConfig(static_cast<const char*>(mapping), length), mapping(mapping), length(length) { }
+
+	~MappedFrozenConfig() {
+		munmap(mapping, length);
+	}
+
+protected:
+	void	*mapping;
+	size_t	length;
+};
+
+
+SharedConfigPublisher::SharedConfigPublisher(const char *name) : name(name), control(0) {
+	int fd = shm_open(name, O_RDWR|O_CREAT, 0644);
+	struct stat st;
+
+	if (fd==-1)
+		throw system_exception(name);
+	if (fstat(fd, &st)==-1 ||
+			(st.st_size<static_cast<off_t>(sizeof(SharedControl)) && ftruncate(fd, sizeof(SharedControl))==-1)) {
+		int err = errno;
+		close(fd);
+		throw system_exception(name, err);
+	}
+
+	void *p = mmap(0, sizeof(SharedControl), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	if (p==MAP_FAILED)
+		throw system_exception(name, err);
+
+	control=static_cast<SharedControl*>(p);
+	if (control->magic!=SharedControl::Magic) {
+		control->generation=0;
+		control->magic=SharedControl::Magic;
+	}
+}
+
+
+SharedConfigPublisher::~SharedConfigPublisher() {
+	munmap(control, sizeof(SharedControl));
+}
+
+
+uint64_t SharedConfigPublisher::Publish(const FrozenConfig &cfg) {
+	const uint64_t previous = control->generation;
+	const uint64_t gen = previous+1;
+	const std::string segment = SegmentName(name, gen);
+
+	// a leftover from a publisher which died halfway is never in use
+	shm_unlink(segment.c_str());
+
+	int fd = shm_open(segment.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644);
+	if (fd==-1)
+		throw system_exception(segment);
+
+	void *p = MAP_FAILED;
+	if (ftruncate(fd, cfg.size())==0)
+		p=mmap(0, cfg.size(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p==MAP_FAILED) {
+		int err = errno;
+		close(fd);
+		shm_unlink(segment.c_str());
+		throw system_exception(segment, err);
+	}
+	close(fd);
+
+	memcpy(p, cfg.data(), cfg.size());
+	munmap(p, cfg.size());
+
+	// the image must be complete before the new generation is visible
+	__sync_synchronize();
+	__sync_val_compare_and_swap(&control->generation, previous, gen);
+
+	if (previous)
+		shm_unlink(SegmentName(name, previous).c_str());
+
+	return gen;
+}
+
+
+uint64_t SharedConfigPublisher::Publish(const ConfigData &cfg) {
+	FrozenConfig frozen(cfg);
+
+	return Publish(frozen);
+}
+
+
+void SharedConfigPublisher::Remove(const char *name) {
+	int fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd!=-1) {
+		void *p = mmap(0, sizeof(SharedControl), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p!=MAP_FAILED) {
+			const SharedControl *control = static_cast<const SharedControl*>(p);
+			if (control->magic==SharedControl::Magic && control->generation)
+				shm_unlink(SegmentName(name, control->generation).c_str());
+			munmap(p, sizeof(SharedControl));
+		}
+	}
+	shm_unlink(name);
+}
+
+
+SharedConfig::SharedConfig(const char *name) : name(name), control(0), current(0) {
+	int fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd==-1)
+		throw system_exception(name);
+
+	void *p = mmap(0, sizeof(SharedControl), PROT_READ, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	if (p==MAP_FAILED)
+		throw system_exception(name, err);
+
+	control=static_cast<const SharedControl*>(p);
+	if (control->magic!=SharedControl::Magic) {
+		munmap(p, sizeof(SharedControl));
+		throw std::runtime_error(std::string(name)+": not a shared configuration");
+	}
+}
+
+
+SharedConfig::~SharedConfig() {
+	config.reset();
+	munmap(const_cast<SharedControl*>(control), sizeof(SharedControl));
+}
+
+
+boost::shared_ptr<FrozenConfig> SharedConfig::Current() {
+	uint64_t gen = control->generation;
+
+	if (gen==current)
+		return config;
+
+	// The publisher unlinks a segment as soon as its successor is
+	// visible, so retry if we lose that race.
+	for (;;) {
+		__sync_synchronize();
+		boost::shared_ptr<FrozenConfig> cfg = Attach(gen);
+		if (cfg) {
+			config=cfg;
+			current=gen;
+			return config;
+		}
+
+		uint64_t now = control->generation;
+		if (now==gen)
+			throw system_exception(SegmentName(name, gen), ENOENT);
+		gen=now;
+	}
+}
+
+
+boost::shared_ptr<FrozenConfig> SharedConfig::Attach(uint64_t gen) {
+	const std::string segment = SegmentName(name, gen);
+	int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+	struct stat st;
+
+	if (fd==-1) {
+		if (errno==ENOENT)
+			return boost::shared_ptr<FrozenConfig>();
+		throw system_exception(segment);
+	}
+
+	void *p = MAP_FAILED;
+	if (fstat(fd, &st)==0)
+		p=mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	if (p==MAP_FAILED)
+		throw system_exception(segment, err);
+
+	try {
+		return boost::shared_ptr<FrozenConfig>(new MappedFrozenConfig(p, st.st_size));
+	} catch (...) {
+		munmap(p, st.st_size);
+		throw;
+	}
+}
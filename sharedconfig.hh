@@ -0,0 +1,131 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_sharedconfig_included__
+#define __wta_sharedconfig_included__
+
+#include <string>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "frozen.hh"
+
+
+/** Control block of a shared configuration.
+ * This lives in its own small shared memory segment. The configuration
+ * image itself is stored in a separate segment per generation.
+ */
+struct SharedControl {
+	enum { Magic = 0x53434953 };	/*!< "SICS" */
+
+	uint32_t		magic;		/*!< Magic */
+	uint32_t		pad;
+	volatile uint64_t	generation;	/*!< current generation, 0 if none */
+};
+
+
+/** Publish configurations in POSIX shared memory.
+ *
+ * A loader process reads and merges the configuration once and publishes
+ * it as a FrozenConfig image. Every published version gets its own shared
+ * memory segment named after the control segment and the generation
+ * number, for example /sict.3 for control segment /sict. Once the image
+ * has been written the generation in the control segment is switched
+ * atomically and the segment of the previous generation is unlinked;
+ * workers which still have it mapped can keep using it until they attach
+ * to the new one.
+ *
+ * Only one publisher should be active for a name at a time.
+ *
+ * \code
+ * SharedConfigPublisher publisher("/sict");
+ * publisher.Publish(*ReadConfig("config"));
+ * \endcode
+ */
+class SharedConfigPublisher : public boost::noncopyable {
+public:
+	/** Open or create the control segment.
+	 * A publisher which is restarted continues with the generation
+	 * found in an existing control segment.
+	 *
+	 * \param name shared memory name of the control segment; must
+	 * 	start with a slash
+	 */
+	explicit SharedConfigPublisher(const char *name);
+	~SharedConfigPublisher();
+
+	/** Publish a frozen configuration.
+	 * \return the new generation
+	 */
+	uint64_t Publish(const FrozenConfig &cfg);
+
+	/** Freeze and publish a configuration.
+	 * \return the new generation
+	 */
+	uint64_t Publish(const ConfigData &cfg);
+
+	/** Return the current generation. */
+	uint64_t generation() const { return control->generation; }
+
+	/** Remove the control segment and the current image.
+	 * Processes which have them mapped are not affected.
+	 */
+	static void Remove(const char *name);
+
+protected:
+	std::string	name;		/*!< name of the control segment */
+	SharedControl	*control;	/*!< mapped control segment */
+};
+
+
+/** Read a configuration published by SharedConfigPublisher.
+ *
+ * Workers map the published image read-only and use it in place, so a
+ * host pays for the configuration once regardless of the number of
+ * processes. Current() only reads the generation from the control segment
+ * as long as nothing new has been published, so it is cheap enough to
+ * call for every request.
+ *
+ * \code
+ * SharedConfig shared("/sict");
+ * ...
+ * boost::shared_ptr<FrozenConfig> cfg = shared.Current();
+ * int port = (*cfg)["radius"]["port"];
+ * \endcode
+ */
+class SharedConfig : public boost::noncopyable {
+public:
+	/** Map the control segment.
+	 * \param name shared memory name of the control segment
+	 */
+	explicit SharedConfig(const char *name);
+	~SharedConfig();
+
+	/** Return the current configuration.
+	 * The image is mapped again if a new generation has been published
+	 * since the last call. The returned configuration stays valid as
+	 * long as a reference to it is kept, even after newer generations
+	 * have been published.
+	 *
+	 * \return the configuration, or a null pointer if nothing has been
+	 * 	published yet
+	 */
+	boost::shared_ptr<FrozenConfig> Current();
+
+	/** Return the generation of the configuration returned last. */
+	uint64_t generation() const { return current; }
+
+protected:
+	/** Map the image of a generation. */
+	boost::shared_ptr<FrozenConfig> Attach(uint64_t gen);
+
+	std::string				name;		/*!< name of the control segment */
+	const SharedControl			*control;	/*!< mapped control segment */
+	uint64_t				current;	/*!< generation of config */
+	boost::shared_ptr<FrozenConfig>		config;		/*!< mapped configuration */
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <cstring>
+#include "stats.hh"
+
+__thread ParseStats *ParseStats::active = 0;
+
+
+void ParseStats::Reset() {
+	memset(time, 0, sizeof(time));
+	memset(tokens, 0, sizeof(tokens));
+	memset(nodes, 0, sizeof(nodes));
+	memset(running, 0, sizeof(running));
+	bytesLoaded=bytesScanned=0;
+	maxDepth=0;
+	mergeVisited=mergeCopied=0;
+	sampledCalls=sampledTime=0;
+}
+
+
+void ParseStats::Print(std::ostream &out) const {
+	static const char *phasenames[] = { "load", "tokenize", "build", "merge" };
+	static const char *tokennames[] = { "string", "integer", "keyword", "character", "whitespace", "comment" };
+	static const char *nodenames[] = { "bogus", "integer", "string", "list", "map" };
+
+	for (int i=0; i<phases; i++)
+		out << "time." << phasenames[i] << "_ns " << time[i] << std::endl;
+	out << "bytes.loaded " << bytesLoaded << std::endl;
+	out << "bytes.scanned " << bytesScanned << std::endl;
+	for (int i=0; i<tokentypes; i++)
+		out << "tokens." << tokennames[i] << " " << tokens[i] << std::endl;
+	for (int i=0; i<5; i++)
+		out << "nodes." << nodenames[i] << " " << nodes[i] << std::endl;
+	out << "depth.max " << maxDepth << std::endl;
+	out << "merge.visited " << mergeVisited << std::endl;
+	out << "merge.copied " << mergeCopied << std::endl;
+}
+
+
+static unsigned long long tokencount(const ParseStats *stats) {
+	unsigned long long count = 0;
+
+	for (int i=0; i<ParseStats::tokentypes; i++)
+		count+=stats->tokens[i];
+	return count;
+}
+
+
+/* Cost of the clock read included in every sampled handler call. */
+static unsigned long long clockoverhead() {
+	static unsigned long long overhead = ~0ULL;
+
+	if (overhead==~0ULL) {
+		unsigned long long best = ~0ULL;
+		for (int i=0; i<16; i++) {
+			unsigned long long start = ParseStats::Now();
+			unsigned long long delta = ParseStats::Now()-start;
+			if (delta<best)
+				best=delta;
+		}
+		overhead=best;
+	}
+	return overhead;
+}
+
+
+ScanTimer::ScanTimer(unsigned long long bytes) : stats(ParseStats::active), bytes(bytes), start(0), tokens(0), calls(0), sampled(0) {
+	if (stats) {
+		start=ParseStats::Now();
+		tokens=tokencount(stats);
+		calls=stats->sampledCalls;
+		sampled=stats->sampledTime;
+	}
+}
+
+
+ScanTimer::~ScanTimer() {
+	if (!stats)
+		return;
+
+	unsigned long long elapsed = ParseStats::Now()-start;
+	unsigned long long ntokens = tokencount(stats)-tokens;
+	unsigned long long ncalls = stats->sampledCalls-calls;
+	unsigned long long build = 0;
+
+	if (ncalls) {
+		unsigned long long handlers = stats->sampledTime-sampled;
+		unsigned long long overhead = clockoverhead()*ncalls;
+
+		handlers=handlers>overhead ? handlers-overhead : 0;
+		build=static_cast<unsigned long long>(static_cast<double>(handlers)*ntokens/ncalls);
+	}
+	if (build>elapsed)
+		build=elapsed;
+
+	stats->bytesScanned+=bytes;
+	stats->time[ParseStats::Build]+=build;
+	stats->time[ParseStats::Tokenize]+=elapsed-build;
+}
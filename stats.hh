@@ -0,0 +1,186 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_stats_included__
+#define __wta_stats_included__
+
+#include <ostream>
+#include <time.h>
+
+/** Parse instrumentation counters.
+ *
+ * When the library is compiled with SICT_STATS defined the file loader,
+ * tokenizer, ISC parser and ConfigData::Merge record what they are doing
+ * in the ParseStats instance made active for the current thread with a
+ * StatsScope. Without SICT_STATS all instrumentation points compile to
+ * nothing and the counters in this structure stay zero.
+ *
+ * Tokenizing and tree building are interleaved: the tokenizer calls the
+ * parser for every token. To tell them apart one in every 64 handler
+ * calls is timed and the handler share of the scan time is extrapolated
+ * from that sample.
+ *
+ * \code
+ * ParseStats stats;
+ * {
+ *     StatsScope scope(stats);
+ *     settings=ReadConfig("config");
+ * }
+ * stats.Print(std::cerr);
+ * \endcode
+ */
+struct ParseStats {
+	/** Phases which are timed. */
+	enum phase_type {
+		Load,		/*!< getting file contents into memory */
+		Tokenize,	/*!< scanning the input for tokens */
+		Build,		/*!< token handlers, e.g. ISCParser building a tree */
+		Merge,		/*!< ConfigData::Merge */
+		phases
+	};
+
+	/** Token kinds which are counted. */
+	enum token_type {
+		StringToken,
+		IntegerToken,
+		KeywordToken,
+		CharacterToken,
+		WhitespaceToken,
+		CommentToken,
+		tokentypes
+	};
+
+	ParseStats() { Reset(); }
+
+	/** Reset all counters to zero. */
+	void Reset();
+
+	/** Write a human readable summary. */
+	void Print(std::ostream &out) const;
+
+	/** Return a monotonic timestamp in nanoseconds. */
+	static unsigned long long Now() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+	}
+
+	unsigned long long time[phases];	/*!< wall time per phase in ns */
+	unsigned long long bytesLoaded;		/*!< bytes read or mapped from files */
+	unsigned long long bytesScanned;	/*!< bytes processed by the tokenizer */
+	unsigned long long tokens[tokentypes];	/*!< tokens seen per kind, including kinds the handler masks */
+	unsigned long long nodes[5];		/*!< nodes created, indexed by ConfigData::data_type */
+	unsigned int maxDepth;			/*!< deepest section nesting seen */
+	unsigned long long mergeVisited;	/*!< source nodes visited by Merge */
+	unsigned long long mergeCopied;		/*!< nodes created by Merge */
+
+	unsigned long long sampledCalls;	/*!< handler calls that were timed */
+	unsigned long long sampledTime;		/*!< time spent in timed handler calls */
+	bool running[phases];			/*!< phase timers currently running */
+
+	/** Statistics collector for the current thread, if any. */
+	static __thread ParseStats *active;
+};
+
+
+/** Activate a ParseStats instance.
+ * Makes a ParseStats instance the active collector for the current thread
+ * for the lifetime of the scope object. Scopes can be nested.
+ */
+class StatsScope {
+public:
+	explicit StatsScope(ParseStats &stats) : previous(ParseStats::active) {
+		ParseStats::active=&stats;
+	}
+
+	~StatsScope() {
+		ParseStats::active=previous;
+	}
+
+private:
+	ParseStats *previous;
+};
+
+
+/** Phase timer.
+ * Adds the lifetime of the timer to a phase of the active collector.
+ * Nested timers for the same phase only count once, so recursive code can
+ * simply create a timer on every call.
+ */
+class StatsTimer {
+public:
+	explicit StatsTimer(ParseStats::phase_type phase) : stats(ParseStats::active), phase(phase), start(0) {
+		if (stats && !stats->running[phase]) {
+			stats->running[phase]=true;
+			start=ParseStats::Now();
+		} else
+			stats=0;
+	}
+
+	~StatsTimer() {
+		if (stats) {
+			stats->time[phase]+=ParseStats::Now()-start;
+			stats->running[phase]=false;
+		}
+	}
+
+private:
+	ParseStats *stats;
+	ParseStats::phase_type phase;
+	unsigned long long start;
+};
+
+
+/** Tokenizer scan timer.
+ * Times a complete tokenizer run and splits the result between the
+ * Tokenize and Build phases using the sampled handler calls made during
+ * the run.
+ */
+class ScanTimer {
+public:
+	/** Standard constructor.
+	 * \param bytes size of the input being scanned
+	 */
+	explicit ScanTimer(unsigned long long bytes);
+	~ScanTimer();
+
+private:
+	ParseStats *stats;
+	unsigned long long bytes;
+	unsigned long long start;
+	unsigned long long tokens;
+	unsigned long long calls;
+	unsigned long long sampled;
+};
+
+
+#ifdef SICT_STATS
+# define STATS_ADD(field, n) \
+	do { if (ParseStats::active) ParseStats::active->field+=(n); } while (0)
+# define STATS_MAX(field, n) \
+	do { if (ParseStats::active && ParseStats::active->field<(n)) ParseStats::active->field=(n); } while (0)
+# define STATS_TIMER(phase) StatsTimer statsTimer_(ParseStats::phase)
+# define STATS_SCAN(bytes) ScanTimer scanTimer_(bytes)
+# define STATS_DISPATCH(kind, call) \
+	do { \
+		ParseStats *stats_ = ParseStats::active; \
+		if (stats_ && !(++stats_->tokens[ParseStats::kind] & 63)) { \
+			unsigned long long start_ = ParseStats::Now(); \
+			call; \
+			stats_->sampledTime+=ParseStats::Now()-start_; \
+			stats_->sampledCalls++; \
+		} else \
+			call; \
+	} while (0)
+#else
+# define STATS_ADD(field, n) ((void)0)
+# define STATS_MAX(field, n) ((void)0)
+# define STATS_TIMER(phase) ((void)0)
+# define STATS_SCAN(bytes) ((void)0)
+# define STATS_DISPATCH(kind, call) call
+#endif
+
+#endif
@@ -4,44 +4,55 @@
  * See COPYING for license information.
  */
 
-#include <cctype>
 #include "tokenize.hh"
 
 void Tokenizer::operator()(TokenHandler &handler) {
-	char		bit;
-	const char	*start;
-	unsigned int	length;
-
-	bit=next();
-	while (size) {
-		length=1;
-		start=input-1;
-		if (isdigit(bit)) {
-			while (size && isdigit(bit=next()))
-				length++;
-
-			handler.HandleInteger(start, length);
-		} else if (bit=='"') {
-			while ((bit=next())!='"')
-				length++;
-			bit=next();
-			handler.HandleString(start+1, length-1);
-		} else if (isspace(bit)) {
-			while (size && isspace(bit=next()))
-				length++;
-
-			handler.HandleWhitespace(start, length);
-		} else  if (isalpha(bit) || bit=='_') {
-			while (size && (isalnum(bit=next()) || bit=='_'))
-				length++;
-
-			handler.HandleKeyword(start, length);
-		} else {
-			handler.HandleCharacter(start, length);
-			if (size)
-				bit=next();
+	Tokenize(handler);
+}
+
+
+static inline int hexdigit(char c) {
+	if (c>='0' && c<='9')
+		return c-'0';
+	if (c>='a' && c<='f')
+		return c-'a'+10;
+	if (c>='A' && c<='F')
+		return c-'A'+10;
+	return -1;
+}
+
+
+const char *Tokenizer::Unescape(const char *p, const char *end, std::string &out) {
+	for (;;) {
+		// p points to a backslash
+		if (++p==end)
+			throw EofError();
+
+		switch (*p) {
+			case '"': out+='"'; break;
+			case '\\': out+='\\'; break;
+			case 'n': out+='\n'; break;
+			case 't': out+='\t'; break;
+			case 'x':
+				if (end-p>2 && hexdigit(p[1])>=0 && hexdigit(p[2])>=0) {
+					out+=static_cast<char>(hexdigit(p[1])<<4 | hexdigit(p[2]));
+					p+=2;
+					break;
+				}
+				// fall through - no break here on purpose!
+
+			default:
+				// not an escape sequence: keep it as it is
+				out+='\\';
+				out+=*p;
 		}
-	}
 
-	handler.HandleEndOfInput();
+		const char *next = FindQuote(++p, end);
+		if (next==end)
+			throw EofError();
+		out.append(p, next);
+		if (*next=='"')
+			return next;
+		p=next;
+	}
 }
@@ -9,9 +9,16 @@
 
 #include <string>
 #include <cassert>
+#include <cctype>
 #include <cstdlib>
+#include <climits>
 #include <cerrno>
+#include <cstring>
 #include "file.hh"
+#include "stats.hh"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 /** Base class for parsing-related errors.
@@ -40,9 +47,30 @@ class EofError : public error {
  */
 class TokenHandler {
 public:
+	/** Token kinds, used as bits in a token mask. */
+	enum token_kind {
+		StringToken	= 1<<0,
+		IntegerToken	= 1<<1,
+		KeywordToken	= 1<<2,
+		CharacterToken	= 1<<3,
+		WhitespaceToken	= 1<<4,
+		CommentToken	= 1<<5,
+		AllTokens	= (1<<6)-1
+	};
+
 	/** Default constructor. */
 	virtual ~TokenHandler() { }
 
+	/** Return the token kinds this handler wants.
+	 * The Tokenizer asks this once before it starts. Tokens of other
+	 * kinds are skipped without calling the handler, which saves a
+	 * call per token for kinds such as whitespace and comments that
+	 * most parsers ignore. The default is all kinds.
+	 *
+	 * \return bitwise or of token_kind values
+	 */
+	virtual unsigned int TokenMask() const { return AllTokens; }
+
 	/** string handler.
 	 * This method is called by a Tokenizer instance when a quoted string
 	 * is found in the input.
@@ -50,7 +78,7 @@ public:
 	 * \param data pointer to found token
 	 * \param length length (in bytes) of the token
 	 */
-	virtual void HandleString(const char *data, unsigned int length) = 0;
+	virtual void HandleString(const char *data, size_t length) = 0;
 
 	/** integer handler.
 	 * This method is called by a Tokenizer instance when an integer
@@ -59,7 +87,7 @@ public:
 	 * \param data pointer to found token
 	 * \param length length (in bytes) of the token
 	 */
-	virtual void HandleInteger(const char *data, unsigned int length) = 0;
+	virtual void HandleInteger(const char *data, size_t length) = 0;
 
 	/** keyword  handler.
 	 * This method is called by a Tokenizer instance when a keyword
@@ -68,7 +96,7 @@ public:
 	 * \param data pointer to found token
 	 * \param length length (in bytes) of the token
 	 */
-	virtual void HandleKeyword(const char *data, unsigned int length) = 0;
+	virtual void HandleKeyword(const char *data, size_t length) = 0;
 
 	/** character handler.
 	 * This method is called by a Tokenizer instance when a character
@@ -78,7 +106,7 @@ public:
 	 * \param data pointer to found token
 	 * \param length length (in bytes) of the token
 	 */
-	virtual void HandleCharacter(const char *data, unsigned int length) = 0;
+	virtual void HandleCharacter(const char *data, size_t length) = 0;
 
 	/** whitespace handler.
 	 * This method is called by a Tokenizer instance when whitespace is
@@ -88,7 +116,20 @@ public:
 	 * \param data pointer to found token
 	 * \param length length (in bytes) of the token
 	 */
-	virtual void HandleWhitespace(const char *data, unsigned int length) = 0;
+	virtual void HandleWhitespace(const char *data, size_t length) = 0;
+
+	/** comment handler.
+	 * This method is called by a Tokenizer instance when a comment is
+	 * found in the input. Comments start with # or // and run to the
+	 * end of the line, or are enclosed in / * and * /. The token
+	 * includes the comment markers but not the line terminator. The
+	 * default implementation ignores comments.
+	 *
+	 * \param data pointer to found token
+	 * \param length length (in bytes) of the token
+	 */
+	virtual void HandleComment(const char *data, size_t length) { (void)data; (void)length; }
+
 	/** end of input.
 	 * This method is called by a Tokenizer instance when it reaches the
 	 * end of its input.
@@ -104,39 +145,60 @@ public:
  * datatypes.
  */
 class ParsedTokenHandler : public TokenHandler {
-	virtual void HandleString(const char *data, unsigned int length) {
-		HandleString(std::string(data, 0, length));
+public:
+	virtual void HandleString(const char *data, size_t length) {
+		HandleString(std::string(data, length));
 	}
 
 
-	virtual void HandleInteger(const char *data, unsigned int length) {
-		char *end;
+	virtual void HandleInteger(const char *data, size_t length) {
 		long int result;
 
-		result=strtol(data, &end, 0);
-		if ((result==LONG_MIN || result==LONG_MAX) && errno==ERANGE)
+		if (!ParseInteger(data, length, result))
 			throw new error();
 
-		if (static_cast<unsigned int>(end-data)>length)
-			throw new error(); // internal error really
-
 		HandleInteger(result);
 	}
 
 
-	virtual void HandleKeyword(const char *data, unsigned int length) {
-		HandleKeyword(std::string(data, 0, length));
+	/** Convert an integer token.
+	 * \param data pointer to the token
+	 * \param length length (in bytes) of the token
+	 * \param result set to the value of the token
+	 * \return false if the value does not fit in a long int
+	 */
+	static bool ParseInteger(const char *data, size_t length, long int &result) {
+		char buf[32];
+		char *end;
+
+		// The input is not NUL-terminated, so convert a bounded copy.
+		if (length>=sizeof(buf))
+			return false;
+		memcpy(buf, data, length);
+		buf[length]=0;
+
+		errno=0;
+		result=strtol(buf, &end, 0);
+		if ((result==LONG_MIN || result==LONG_MAX) && errno==ERANGE)
+			return false;
+
+		return static_cast<size_t>(end-buf)<=length;
+	}
+
+
+	virtual void HandleKeyword(const char *data, size_t length) {
+		HandleKeyword(std::string(data, length));
 	}
 
 
-	virtual void HandleCharacter(const char *data, unsigned int length) {
+	virtual void HandleCharacter(const char *data, size_t length) {
 		assert(length==1);
 		HandleCharacter(data[0]);
 	}
 
 
-	virtual void HandleWhitespace(const char *data, unsigned int length) {
-		HandleWhitespace(std::string(data, 0, length));
+	virtual void HandleWhitespace(const char *data, size_t length) {
+		HandleWhitespace(std::string(data, length));
 	}
 	
 	/** Handle a string token.
@@ -186,6 +248,11 @@ class ParsedTokenHandler : public TokenHandler {
  * A Tokenizer extracts tokens from its input and feeds them to a TokenHandler
  * instance.
  *
+ * Strings may contain the escape sequences \\", \\\\, \\n, \\t and \\xNN.
+ * A backslash followed by anything else is kept as it is. Strings without
+ * escape sequences are passed to the handler straight from the input;
+ * only strings with escapes are decoded into a buffer.
+ *
  * \sa TokenHandler
  */
 class Tokenizer {
@@ -196,7 +263,7 @@ public:
 	 *
 	 * \param input file to read data from
 	 */
-	Tokenizer(MemoryFile &input) : input(input.data), size(input.size) { }
+	Tokenizer(MemoryFile &input) : input(input.data), size(input.size), begin(input.data), token(input.data) { }
 
 	/** Memory-reading constructor.
 	 * This constructor creates a Tokenizer which takes its input from
@@ -205,7 +272,7 @@ public:
 	 * \param data pointer to memory buffer containing data to tokenize
 	 * \param length size in bytes of buffer to parse.
 	 */
-	Tokenizer(const char *data, unsigned int length) : input(data), size(length) { }
+	Tokenizer(const char *data, size_t length) : input(data), size(length), begin(data), token(data) { }
 
 	/** Run tokenizing loop.
 	 * Calling a Tokenizer instance as a function using this operator
@@ -216,23 +283,278 @@ public:
 	 */
 	void operator()(TokenHandler &handler);
 
-protected:
+	/** Run tokenizing loop with static dispatch.
+	 * This works like operator(), but calls the handler methods of
+	 * \a Handler directly. \a Handler does not have to be derived from
+	 * TokenHandler, it only needs the same handler methods. This is
+	 * used to feed a TokenPair without virtual calls.
+	 *
+	 * \param handler token handler
+	 */
+	template<class Handler>
+	void Tokenize(Handler &handler) {
+		if (Scan<Handler, false>(handler)) {
+			size=0;
+			token=input;
+			handler.HandleEndOfInput();
+		}
+	}
 
-	/** Helper function to get the next character.
-	 * Gets the next character from input or throw an exception if
-	 * the end of input is reached.
+	/** Tokenize a block of input which is followed by more input.
+	 * Passes all complete tokens to the handler, but stops at a token
+	 * which extends to the end of the block since it may continue in
+	 * the next block. The handler is not told about the end of the
+	 * input. This is used to feed input that arrives in blocks, for
+	 * example from a decompressor: the unused tail of a block has to
+	 * be passed again at the start of the next one.
+	 *
+	 * \param handler token handler
+	 * \return number of bytes used
 	 */
-	char next() {
-		if (!size)
-			throw EofError();
-		size--;
-		return *input++;
+	template<class Handler>
+	size_t TokenizePartial(Handler &handler) {
+		Scan<Handler, true>(handler);
+		return input-begin;
 	}
 
+	/** Return the offset of the current token.
+	 * This is the byte offset in the input of the token last passed to
+	 * the handler, or the size of the input once the end has been
+	 * reached. When a handler throws this locates the offending token.
+	 */
+	size_t offset() const { return token-begin; }
+
+protected:
+
+	/** Return the first byte at or after \a p which is not whitespace,
+	 * or \a end. */
+	static const char *SkipWhitespace(const char *p, const char *end);
+
+	/** Return the end of the comment starting at \a p, which must point
+	 * to # or to a / followed by / or *. Throws EofError if a block
+	 * comment is not terminated. */
+	static const char *SkipComment(const char *p, const char *end);
+
+	/** Return the first double quote or backslash at or after \a p, or
+	 * \a end. */
+	static const char *FindQuote(const char *p, const char *end);
+
+	/** Decode the rest of a string with escape sequences.
+	 * \a p points to the first backslash; the decoded string is appended
+	 * to \a out. Throws EofError if the string is not terminated.
+	 *
+	 * \return the closing quote
+	 */
+	static const char *Unescape(const char *p, const char *end, std::string &out);
+
+	/** Tokenizing loop.
+	 * In \a Partial mode a token which reaches the end of the input is
+	 * not handled and input is left at its start.
+	 *
+	 * \return true if the end of the input was reached
+	 */
+	template<class Handler, bool Partial>
+	bool Scan(Handler &handler);
 
 	const char	*input;	/*!< current position in the input stream */
-	unsigned int	size;	/*!< remaining size of the input buffer */
+	size_t		size;	/*!< remaining size of the input buffer */
+	const char	*begin;	/*!< start of the input buffer */
+	const char	*token;	/*!< start of the current token */
 };
 
+
+inline const char *Tokenizer::SkipWhitespace(const char *p, const char *end) {
+#ifdef __SSE2__
+	// Most whitespace runs are short, so test the next byte first.
+	if (p<end && !isspace(static_cast<unsigned char>(*p)))
+		return p;
+
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i low = _mm_set1_epi8('\t'-1);
+	const __m128i high = _mm_set1_epi8('\r'+1);
+
+	while (end-p>=16) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i ws = _mm_or_si128(_mm_cmpeq_epi8(block, space),
+				_mm_and_si128(_mm_cmpgt_epi8(block, low), _mm_cmplt_epi8(block, high)));
+		unsigned int mask = ~_mm_movemask_epi8(ws) & 0xffff;
+
+		if (mask)
+			return p+__builtin_ctz(mask);
+		p+=16;
+	}
+#endif
+	while (p<end && isspace(static_cast<unsigned char>(*p)))
+		p++;
+	return p;
+}
+
+
+inline const char *Tokenizer::SkipComment(const char *p, const char *end) {
+	if (*p=='#' || p[1]=='/') {
+		const char *eol = static_cast<const char*>(memchr(p, '\n', end-p));
+		return eol ? eol : end;
+	}
+
+	for (p+=2; p<end; p++) {
+		if (!(p=static_cast<const char*>(memchr(p, '*', end-p))))
+			break;
+		if (p+1<end && p[1]=='/')
+			return p+2;
+	}
+	throw EofError();
+}
+
+
+inline const char *Tokenizer::FindQuote(const char *p, const char *end) {
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+
+	// Long strings are common, so test 64 bytes per round.
+	while (end-p>=64) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+32));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+48));
+		a=_mm_or_si128(_mm_cmpeq_epi8(a, quote), _mm_cmpeq_epi8(a, backslash));
+		b=_mm_or_si128(_mm_cmpeq_epi8(b, quote), _mm_cmpeq_epi8(b, backslash));
+		c=_mm_or_si128(_mm_cmpeq_epi8(c, quote), _mm_cmpeq_epi8(c, backslash));
+		d=_mm_or_si128(_mm_cmpeq_epi8(d, quote), _mm_cmpeq_epi8(d, backslash));
+
+		if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))))
+			break;
+		p+=64;
+	}
+
+	while (end-p>=16) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)));
+
+		if (mask)
+			return p+__builtin_ctz(mask);
+		p+=16;
+	}
+#endif
+	while (p<end && *p!='"' && *p!='\\')
+		p++;
+	return p;
+}
+
+
+template<class Handler, bool Partial>
+bool Tokenizer::Scan(Handler &handler) {
+	const unsigned int mask = handler.TokenMask();
+	const char *end = input+size;
+	const char *start;
+	std::string scratch;	// decoded strings with escape sequences
+	STATS_SCAN(size);
+
+	while (input<end) {
+		const unsigned char bit = *input;
+
+		token=start=input;
+		if (isdigit(bit)) {
+			while (++input<end && isdigit(static_cast<unsigned char>(*input)))
+				;
+
+			if (Partial && input==end) {
+				input=start;
+				break;
+			}
+			if (mask & TokenHandler::IntegerToken)
+				STATS_DISPATCH(IntegerToken, handler.HandleInteger(start, input-start));
+			else
+				STATS_ADD(tokens[ParseStats::IntegerToken], 1);
+		} else if (bit=='"') {
+			const char *quote = FindQuote(start+1, end);
+
+			if (quote==end) {
+				if (Partial) {
+					input=start;
+					break;
+				}
+				input=end;
+				throw EofError();
+			}
+			if (*quote=='"') {
+				input=quote+1;
+				if (mask & TokenHandler::StringToken)
+					STATS_DISPATCH(StringToken, handler.HandleString(start+1, quote-start-1));
+				else
+					STATS_ADD(tokens[ParseStats::StringToken], 1);
+			} else {
+				scratch.assign(start+1, quote);
+				try {
+					input=Unescape(quote, end, scratch)+1;
+				} catch (EofError&) {
+					if (!Partial)
+						throw;
+					input=start;
+					break;
+				}
+				if (mask & TokenHandler::StringToken)
+					STATS_DISPATCH(StringToken, handler.HandleString(scratch.data(), scratch.size()));
+				else
+					STATS_ADD(tokens[ParseStats::StringToken], 1);
+			}
+		} else if (isspace(bit)) {
+			input=SkipWhitespace(input+1, end);
+
+			if (Partial && input==end) {
+				input=start;
+				break;
+			}
+			if (mask & TokenHandler::WhitespaceToken)
+				STATS_DISPATCH(WhitespaceToken, handler.HandleWhitespace(start, input-start));
+			else
+				STATS_ADD(tokens[ParseStats::WhitespaceToken], 1);
+		} else if (isalpha(bit) || bit=='_') {
+			while (++input<end && (isalnum(static_cast<unsigned char>(*input)) || *input=='_'))
+				;
+
+			if (Partial && input==end) {
+				input=start;
+				break;
+			}
+			if (mask & TokenHandler::KeywordToken)
+				STATS_DISPATCH(KeywordToken, handler.HandleKeyword(start, input-start));
+			else
+				STATS_ADD(tokens[ParseStats::KeywordToken], 1);
+		} else if (bit=='#' || (bit=='/' && input+1<end && (input[1]=='/' || input[1]=='*'))) {
+			try {
+				input=SkipComment(input, end);
+			} catch (EofError&) {
+				if (!Partial)
+					throw;
+				input=start;
+				break;
+			}
+
+			if (Partial && input==end) {
+				input=start;
+				break;
+			}
+			if (mask & TokenHandler::CommentToken)
+				STATS_DISPATCH(CommentToken, handler.HandleComment(start, input-start));
+			else
+				STATS_ADD(tokens[ParseStats::CommentToken], 1);
+		} else {
+			// a / at the end may start a comment
+			if (Partial && bit=='/' && input+1==end)
+				break;
+			input++;
+			if (mask & TokenHandler::CharacterToken)
+				STATS_DISPATCH(CharacterToken, handler.HandleCharacter(start, 1));
+			else
+				STATS_ADD(tokens[ParseStats::CharacterToken], 1);
+		}
+	}
+
+	// in partial mode input may have stopped at a token which may continue
+	return input>=end;
+}
+
 #endif
 
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include "tokentee.hh"
+
+
+unsigned int TokenTee::TokenMask() const {
+	unsigned int mask = 0;
+
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		mask|=i->second;
+	return mask;
+}
+
+
+void TokenTee::HandleString(const char *data, size_t length) {
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		if (i->second & StringToken)
+			i->first->HandleString(data, length);
+}
+
+
+void TokenTee::HandleInteger(const char *data, size_t length) {
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		if (i->second & IntegerToken)
+			i->first->HandleInteger(data, length);
+}
+
+
+void TokenTee::HandleKeyword(const char *data, size_t length) {
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		if (i->second & KeywordToken)
+			i->first->HandleKeyword(data, length);
+}
+
+
+void TokenTee::HandleCharacter(const char *data, size_t length) {
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		if (i->second & CharacterToken)
+			i->first->HandleCharacter(data, length);
+}
+
+
+void TokenTee::HandleWhitespace(const char *data, size_t length) {
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		if (i->second & WhitespaceToken)
+			i->first->HandleWhitespace(data, length);
+}
+
+
+void TokenTee::HandleComment(const char *data, size_t length) {
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		if (i->second & CommentToken)
+			i->first->HandleComment(data, length);
+}
+
+
+void TokenTee::HandleEndOfInput() {
+	for (handler_list::const_iterator i=handlers.begin(); i!=handlers.end(); i++)
+		i->first->HandleEndOfInput();
+}
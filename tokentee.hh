@@ -0,0 +1,146 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_tokentee_included__
+#define __wta_tokentee_included__
+
+#include <utility>
+#include <vector>
+#include "tokenize.hh"
+
+
+/** Token fan-out handler.
+ *
+ * A TokenTee passes every token it receives on to a list of other token
+ * handlers, in the order in which they were added. This makes it possible
+ * to run several consumers, for example a parser and a checksum handler,
+ * from a single scan of the input.
+ *
+ * Every handler only receives the token kinds in its own TokenMask. If a
+ * handler throws the exception is passed on immediately and the remaining
+ * handlers do not see that token.
+ *
+ * \code
+ * ISCParser parser;
+ * AuditHandler audit;
+ * TokenTee tee;
+ * tee.Add(parser);
+ * tee.Add(audit);
+ * Tokenizer toker(input);
+ * toker(tee);
+ * \endcode
+ *
+ * \sa TokenPair
+ */
+class TokenTee : public TokenHandler {
+public:
+	/** Add a handler.
+	 * The handler is not copied and must outlive the TokenTee.
+	 */
+	void Add(TokenHandler &handler) {
+		handlers.push_back(std::make_pair(&handler, handler.TokenMask()));
+	}
+
+	/** Return the token kinds wanted by any of the handlers.
+	 * Each handler only gets the kinds in its own mask.
+	 */
+	virtual unsigned int TokenMask() const;
+
+	virtual void HandleString(const char *data, size_t length);
+	virtual void HandleInteger(const char *data, size_t length);
+	virtual void HandleKeyword(const char *data, size_t length);
+	virtual void HandleCharacter(const char *data, size_t length);
+	virtual void HandleWhitespace(const char *data, size_t length);
+	virtual void HandleComment(const char *data, size_t length);
+	virtual void HandleEndOfInput();
+
+protected:
+	typedef std::vector<std::pair<TokenHandler*, unsigned int> > handler_list;
+
+	handler_list	handlers;	/*!< handlers to pass tokens to, with their token masks */
+};
+
+
+/** Static token fan-out handler.
+ *
+ * TokenPair does the same as TokenTee for a fixed pair of handlers whose
+ * types are known at compile time. All calls are made directly, so when
+ * it is run with Tokenizer::Tokenize no virtual calls are needed to get a
+ * token to a handler. More than two handlers can be combined by nesting:
+ * TokenPair<A, TokenPair<B, C> >.
+ *
+ * \code
+ * ISCParser parser;
+ * AuditHandler audit;
+ * TokenPair<ISCParser, AuditHandler> pair(parser, audit);
+ * Tokenizer(input).Tokenize(pair);
+ * \endcode
+ */
+template<class First, class Second>
+class TokenPair {
+public:
+	TokenPair(First &first, Second &second) : first(first), second(second),
+		firstMask(first.First::TokenMask()), secondMask(second.Second::TokenMask()) { }
+
+	unsigned int TokenMask() const {
+		return firstMask|secondMask;
+	}
+
+	void HandleString(const char *data, size_t length) {
+		if (firstMask & TokenHandler::StringToken)
+			first.First::HandleString(data, length);
+		if (secondMask & TokenHandler::StringToken)
+			second.Second::HandleString(data, length);
+	}
+
+	void HandleInteger(const char *data, size_t length) {
+		if (firstMask & TokenHandler::IntegerToken)
+			first.First::HandleInteger(data, length);
+		if (secondMask & TokenHandler::IntegerToken)
+			second.Second::HandleInteger(data, length);
+	}
+
+	void HandleKeyword(const char *data, size_t length) {
+		if (firstMask & TokenHandler::KeywordToken)
+			first.First::HandleKeyword(data, length);
+		if (secondMask & TokenHandler::KeywordToken)
+			second.Second::HandleKeyword(data, length);
+	}
+
+	void HandleCharacter(const char *data, size_t length) {
+		if (firstMask & TokenHandler::CharacterToken)
+			first.First::HandleCharacter(data, length);
+		if (secondMask & TokenHandler::CharacterToken)
+			second.Second::HandleCharacter(data, length);
+	}
+
+	void HandleWhitespace(const char *data, size_t length) {
+		if (firstMask & TokenHandler::WhitespaceToken)
+			first.First::HandleWhitespace(data, length);
+		if (secondMask & TokenHandler::WhitespaceToken)
+			second.Second::HandleWhitespace(data, length);
+	}
+
+	void HandleComment(const char *data, size_t length) {
+		if (firstMask & TokenHandler::CommentToken)
+			first.First::HandleComment(data, length);
+		if (secondMask & TokenHandler::CommentToken)
+			second.Second::HandleComment(data, length);
+	}
+
+	void HandleEndOfInput() {
+		first.First::HandleEndOfInput();
+		second.Second::HandleEndOfInput();
+	}
+
+protected:
+	First		&first;
+	Second		&second;
+	unsigned int	firstMask;	/*!< token kinds wanted by first */
+	unsigned int	secondMask;	/*!< token kinds wanted by second */
+};
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#include <pthread.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <boost/unordered_map.hpp>
+#include "trace.hh"
+#include "configdata.hh"
+
+volatile bool AccessTrace::enabled = false;
+unsigned int AccessTrace::sampleMask = 255;
+__thread unsigned int AccessTrace::tick = 0;
+
+
+namespace {
+
+/* Counters for one entry. */
+struct TraceCounter {
+	TraceCounter() : samples(0), sampleTime(0) {
+		memset(count, 0, sizeof(count));
+	}
+
+	unsigned long long	count[AccessTrace::accesses];
+	unsigned long long	samples;
+	unsigned long long	sampleTime;
+};
+
+typedef boost::unordered_map<const ConfigData*, TraceCounter> counter_map;
+
+/* Counters of one thread. The lock is only contended while a report is
+ * being collected. */
+struct TraceShard {
+	TraceShard() {
+		pthread_mutex_init(&lock, 0);
+	}
+
+	pthread_mutex_t	lock;
+	counter_map	counters;
+};
+
+/* Shards are never freed, so counts of threads which have exited still
+ * show up in reports. */
+pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+std::vector<TraceShard*> shards;
+__thread TraceShard *shard = 0;
+
+
+struct MoreAccesses {
+	bool operator()(const AccessTraceEntry &a, const AccessTraceEntry &b) const {
+		if (a.total()!=b.total())
+			return a.total()>b.total();
+		return a.path<b.path;
+	}
+};
+
+}
+
+
+void AccessTrace::Start(unsigned int sampleRate) {
+	unsigned int rate = 1;
+
+	while (rate<sampleRate && rate<(1u<<31))
+		rate<<=1;
+	sampleMask=rate-1;
+	enabled=true;
+}
+
+
+void AccessTrace::Stop() {
+	enabled=false;
+}
+
+
+void AccessTrace::Reset() {
+	pthread_mutex_lock(&registryLock);
+	for (std::vector<TraceShard*>::iterator i=shards.begin(); i!=shards.end(); i++) {
+		pthread_mutex_lock(&(*i)->lock);
+		(*i)->counters.clear();
+		pthread_mutex_unlock(&(*i)->lock);
+	}
+	pthread_mutex_unlock(&registryLock);
+}
+
+
+void AccessTrace::Record(const ConfigData *node, access_type how, unsigned long long elapsed, bool sampled) {
+	if (!shard) {
+		shard=new TraceShard;
+		pthread_mutex_lock(&registryLock);
+		shards.push_back(shard);
+		pthread_mutex_unlock(&registryLock);
+	}
+
+	pthread_mutex_lock(&shard->lock);
+	TraceCounter &counter = shard->counters[node];
+	counter.count[how]++;
+	if (sampled) {
+		counter.samples++;
+		counter.sampleTime+=elapsed;
+	}
+	pthread_mutex_unlock(&shard->lock);
+}
+
+
+void AccessTrace::Collect(const ConfigData &root, std::vector<AccessTraceEntry> &result) {
+	counter_map total;
+
+	pthread_mutex_lock(&registryLock);
+	for (std::vector<TraceShard*>::const_iterator s=shards.begin(); s!=shards.end(); s++) {
+		pthread_mutex_lock(&(*s)->lock);
+		for (counter_map::const_iterator i=(*s)->counters.begin(); i!=(*s)->counters.end(); i++) {
+			TraceCounter &sum = total[i->first];
+			for (int j=0; j<accesses; j++)
+				sum.count[j]+=i->second.count[j];
+			sum.samples+=i->second.samples;
+			sum.sampleTime+=i->second.sampleTime;
+		}
+		pthread_mutex_unlock(&(*s)->lock);
+	}
+	pthread_mutex_unlock(&registryLock);
+
+	// Walk the tree to find the paths of the traced entries.
+	std::vector<std::pair<const ConfigData*, std::string> > stack;
+
+	stack.push_back(std::make_pair(&root, std::string()));
+	while (!stack.empty()) {
+		const ConfigData *node = stack.back().first;
+		std::string path;
+
+		path.swap(stack.back().second);
+		stack.pop_back();
+
+		counter_map::iterator found = total.find(node);
+		if (found!=total.end()) {
+			AccessTraceEntry entry;
+
+			entry.path=path.empty() ? "/" : path;
+			entry.node=node;
+			entry.lookups=found->second.count[Lookup];
+			entry.reads=found->second.count[Read];
+			entry.samples=found->second.samples;
+			entry.sampleTime=found->second.sampleTime;
+			result.push_back(entry);
+			// an entry reachable through several paths is reported once
+			total.erase(found);
+		}
+
+		if (node->type==ConfigData::Map) {
+			for (ConfigData::map_type::const_reverse_iterator i=node->mapValue.rbegin(); i!=node->mapValue.rend(); i++)
+				stack.push_back(std::make_pair(i->second.get(), path.empty() ? i->first : path+"/"+i->first));
+		} else if (node->type==ConfigData::List) {
+			// a packed list which was never expanded has no traced entries
+			const ConfigData::list_type *entries = node->packed ? node->packed->Cached() : &node->listValue;
+
+			for (size_t i=entries ? entries->size() : 0; i>0; i--) {
+				char index[24];
+				snprintf(index, sizeof(index), "%lu", static_cast<unsigned long>(i-1));
+				stack.push_back(std::make_pair((*entries)[i-1].get(), path.empty() ? std::string(index) : path+"/"+index));
+			}
+		}
+	}
+
+	// whatever is left is not part of this tree
+	if (!total.empty()) {
+		AccessTraceEntry entry;
+
+		entry.path="(unknown)";
+		entry.node=0;
+		entry.lookups=entry.reads=entry.samples=entry.sampleTime=0;
+		for (counter_map::const_iterator i=total.begin(); i!=total.end(); i++) {
+			entry.lookups+=i->second.count[Lookup];
+			entry.reads+=i->second.count[Read];
+			entry.samples+=i->second.samples;
+			entry.sampleTime+=i->second.sampleTime;
+		}
+		result.push_back(entry);
+	}
+
+	std::sort(result.begin(), result.end(), MoreAccesses());
+}
+
+
+void AccessTrace::Report(const ConfigData &root, std::ostream &out, size_t top) {
+	std::vector<AccessTraceEntry> entries;
+
+	Collect(root, entries);
+	out << std::setw(12) << "lookups" << std::setw(12) << "reads"
+		<< std::setw(10) << "avg_ns" << "  path" << std::endl;
+	for (size_t i=0; i<entries.size() && i<top; i++) {
+		const AccessTraceEntry &e = entries[i];
+
+		out << std::setw(12) << e.lookups << std::setw(12) << e.reads << std::setw(10);
+		if (e.samples)
+			out << e.sampleTime/e.samples;
+		else
+			out << "-";
+		out << "  " << e.path << std::endl;
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2005 Wichert Akkerman <wichert@wiggy.net>
+ *
+ * See COPYING for license information.
+ */
+
+#ifndef __wta_trace_included__
+#define __wta_trace_included__
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "stats.hh"
+
+class ConfigData;
+
+
+/** One line of an access trace report. */
+struct AccessTraceEntry {
+	std::string		path;		/*!< path of the entry */
+	const ConfigData	*node;		/*!< the entry, 0 for entries not in the tree */
+	unsigned long long	lookups;	/*!< times returned by operator[] */
+	unsigned long long	reads;		/*!< times read with a cast operator */
+	unsigned long long	samples;	/*!< accesses which were timed */
+	unsigned long long	sampleTime;	/*!< total time of timed accesses in ns */
+
+	/** Return the total number of accesses. */
+	unsigned long long total() const { return lookups+reads; }
+};
+
+
+/** ConfigData access tracing.
+ *
+ * When the library is compiled with SICT_TRACE defined the ConfigData
+ * access and cast operators count how often every entry is used, so hot
+ * lookups in request loops can be found. Tracing is off until Start() is
+ * called; while it is off every access costs a single test. Without
+ * SICT_TRACE the operators are not instrumented at all.
+ *
+ * Every thread counts in its own table, so threads do not contend on
+ * shared counters. Counters are kept per entry; Report() translates
+ * entries to paths by walking the tree passed to it. One in every
+ * sampleRate accesses is timed as well.
+ *
+ * Counters refer to entries by address. Entries of trees which have been
+ * released since Start() are reported as unknown, or worse, counted
+ * against a newer entry which happens to use the same memory.
+ *
+ * \code
+ * AccessTrace::Start();
+ * ...
+ * AccessTrace::Report(*settings, std::cerr, 20);
+ * \endcode
+ */
+class AccessTrace {
+public:
+	/** Kinds of access. */
+	enum access_type {
+		Lookup,		/*!< entry returned by operator[] */
+		Read,		/*!< entry read with a cast operator */
+		accesses
+	};
+
+	/** Start tracing.
+	 * \param sampleRate time one in every \a sampleRate accesses;
+	 * 	rounded up to a power of two
+	 */
+	static void Start(unsigned int sampleRate=256);
+
+	/** Stop tracing. Collected counters are kept. */
+	static void Stop();
+
+	/** Reset the counters of all threads. */
+	static void Reset();
+
+	/** Collect the counters of all threads.
+	 * \param root tree used to find the paths of entries
+	 * \param result receives one entry per traced entry, most accessed
+	 * 	first
+	 */
+	static void Collect(const ConfigData &root, std::vector<AccessTraceEntry> &result);
+
+	/** Write the most accessed entries.
+	 * \param root tree used to find the paths of entries
+	 * \param out stream to write the report to
+	 * \param top number of entries to report
+	 */
+	static void Report(const ConfigData &root, std::ostream &out, size_t top=20);
+
+	/** Begin an access.
+	 * \return 0 if tracing is off, 1 for an access which is not timed,
+	 * 	or the start time
+	 */
+	static unsigned long long Begin() {
+		if (!enabled)
+			return 0;
+		if (++tick & sampleMask)
+			return 1;
+		return ParseStats::Now();
+	}
+
+	/** Complete an access started with Begin(). */
+	static void End(unsigned long long start, const ConfigData *node, access_type how) {
+		if (start)
+			Record(node, how, start==1 ? 0 : ParseStats::Now()-start, start!=1);
+	}
+
+	static volatile bool		enabled;	/*!< tracing is on */
+	static unsigned int		sampleMask;	/*!< sampleRate-1 */
+
+protected:
+	/** Count an access in the table of the current thread. */
+	static void Record(const ConfigData *node, access_type how, unsigned long long elapsed, bool sampled);
+
+	static __thread unsigned int	tick;		/*!< accesses in this thread */
+};
+
+
+#ifdef SICT_TRACE
+# define TRACE_BEGIN() const unsigned long long traceStart_ = AccessTrace::Begin()
+# define TRACE_END(node, how) AccessTrace::End(traceStart_, node, AccessTrace::how)
+#else
+# define TRACE_BEGIN() ((void)0)
+# define TRACE_END(node, how) ((void)0)
+#endif
+
+#endif